@@ -931,6 +931,9 @@ MPP_RET super_enc_mpp_process(SuperEncCtx *sec)
     RK_U32 cap_num = 0;
     RK_FLOAT psnr_const = 0;
     RK_U32 sse_unit_in_pixel = 0;
+    /* map the nn filled for this frame, released when its packet comes back */
+    ObjMap *obj_map = obj_map_ring_find(&sec->obj_maps, sec->frame_count);
+    RK_S32 fg_area = obj_map ? obj_map->foreground_area : 0;
 
     mppp_dbg_func("enter\n");
 
@@ -975,8 +978,8 @@ MPP_RET super_enc_mpp_process(SuperEncCtx *sec)
             if (sptr_test.uptr) {
                 object_map_result_list *dst = sptr_test.uptr;
                 memset(dst, 0, p->obj_size);
-                if (sec->om_results.object_seg_map)
-                    memcpy((void *)dst, sec->om_results.object_seg_map, p->obj_size);
+                if (obj_map)
+                    memcpy((void *)dst, obj_map->map, MPP_MIN(p->obj_size, obj_map->size));
                 mpp_log("obj_buf %p size %d\n", dst, p->obj_size);
                 kmpp_buffer_flush(p->obj_kbuf);
             }
@@ -984,7 +987,7 @@ MPP_RET super_enc_mpp_process(SuperEncCtx *sec)
             sptr_p = kmpp_obj_to_shm(p->obj_kbuf);
             kmpp_meta_set_shm(kmeta, KEY_NPU_SOBJ_FLAG, sptr_p);
 
-            mpp_enc_cfg_set_s32(p->cfg, "tune:fg_area", sec->om_results.foreground_area);
+            mpp_enc_cfg_set_s32(p->cfg, "tune:fg_area", fg_area);
             ret = mpi->control(ctx, MPP_ENC_SET_CFG, p->cfg);
             if (ret) {
                 mpp_err("mpi control enc set cfg failed ret %d\n", ret);
@@ -1095,6 +1098,11 @@ MPP_RET super_enc_mpp_process(SuperEncCtx *sec)
                 p->stream_size += len;
                 p->frame_count += eoi;
 
+                if (eoi && obj_map) {
+                    obj_map_ring_put(&sec->obj_maps, obj_map);
+                    obj_map = NULL;
+                }
+
                 if (p->pkt_eos) {
                     mpp_log_q(quiet, "chn %d found last packet\n", chn);
                     mpp_assert(p->frm_eos);
@@ -1104,6 +1112,9 @@ MPP_RET super_enc_mpp_process(SuperEncCtx *sec)
     }
 
 RET:
+    if (obj_map)
+        obj_map_ring_put(&sec->obj_maps, obj_map);
+
     mppp_dbg_func("exit\n");
 
     return ret;
@@ -1124,6 +1135,9 @@ MPP_RET super_enc_mpp_process(SuperEncCtx *sec)
     RK_U32 cap_num = 0;
     RK_FLOAT psnr_const = 0;
     RK_U32 sse_unit_in_pixel = 0;
+    /* map the nn filled for this frame, released when its packet comes back */
+    ObjMap *obj_map = obj_map_ring_find(&sec->obj_maps, sec->frame_count);
+    RK_S32 fg_area = obj_map ? obj_map->foreground_area : 0;
 
     mppp_dbg_func("enter\n");
 
@@ -1169,17 +1183,17 @@ MPP_RET super_enc_mpp_process(SuperEncCtx *sec)
         mpp_meta_set_buffer(meta, KEY_MOTION_INFO, p->md_info);
 
         if (p->rc_mode == MPP_ENC_RC_MODE_SE || cmd->smart_en == 3) {
-            mpp_enc_cfg_set_s32(p->cfg, "tune:fg_area", sec->om_results.foreground_area);
+            mpp_enc_cfg_set_s32(p->cfg, "tune:fg_area", fg_area);
             ret = mpi->control(ctx, MPP_ENC_SET_CFG, p->cfg);
             if (ret) {
                 mpp_err("mpi control enc set cfg failed ret %d\n", ret);
                 goto RET;
             }
 
-            ret = mpp_meta_set_ptr(meta, KEY_NPU_UOBJ_FLAG, sec->om_results.object_seg_map);
+            ret = mpp_meta_set_ptr(meta, KEY_NPU_UOBJ_FLAG, obj_map ? obj_map->map : NULL);
             if(ret)
                 mpp_err_f("meta %p set npu obj flag %p failed ret %d\n",
-                          meta, sec->om_results.object_seg_map, ret);
+                          meta, obj_map ? obj_map->map : NULL, ret);
         }
 
         if (p->osd_enable || p->user_data_enable || p->roi_enable) {
@@ -1337,6 +1351,11 @@ MPP_RET super_enc_mpp_process(SuperEncCtx *sec)
                 p->stream_size += len;
                 p->frame_count += eoi;
 
+                if (eoi && obj_map) {
+                    obj_map_ring_put(&sec->obj_maps, obj_map);
+                    obj_map = NULL;
+                }
+
                 if (p->pkt_eos) {
                     mpp_log_q(quiet, "chn %d found last packet\n", chn);
                     mpp_assert(p->frm_eos);
@@ -1346,6 +1365,9 @@ MPP_RET super_enc_mpp_process(SuperEncCtx *sec)
     }
 
 RET:
+    if (obj_map)
+        obj_map_ring_put(&sec->obj_maps, obj_map);
+
     mppp_dbg_func("exit\n");
 
     return ret;
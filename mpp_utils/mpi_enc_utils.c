@@ -857,6 +857,69 @@ RK_S32 mpi_enc_opt_show_time(void *ctx, const char *next)
     return 0;
 }
 
+RK_S32 mpi_enc_opt_nn_max_obj(void *ctx, const char *next)
+{
+    MpiEncTestArgs *cmd = (MpiEncTestArgs *)ctx;
+
+    if (next) {
+        cmd->nn_max_obj = atoi(next);
+        return 1;
+    }
+
+    mpp_err("invalid nn_max_obj\n");
+    return 0;
+}
+
+RK_S32 mpi_enc_opt_nn_cls(void *ctx, const char *next)
+{
+    MpiEncTestArgs *cmd = (MpiEncTestArgs *)ctx;
+    const char *str = next;
+    char *end = NULL;
+
+    cmd->nn_cls_num = 0;
+    while (str && *str && cmd->nn_cls_num < NN_CLASS_MAX_NUM) {
+        RK_S32 id = strtol(str, &end, 10);
+
+        if (end == str || id < 0)
+            break;
+
+        cmd->nn_cls[cmd->nn_cls_num++] = id;
+        str = (*end == ':') ? end + 1 : end;
+    }
+
+    if (cmd->nn_cls_num)
+        return 1;
+
+    mpp_err("invalid nn class list usage -nn_cls id0:id1:...\n");
+    return 0;
+}
+
+RK_S32 mpi_enc_opt_nn_cls_only(void *ctx, const char *next)
+{
+    MpiEncTestArgs *cmd = (MpiEncTestArgs *)ctx;
+
+    if (next) {
+        cmd->nn_cls_only = atoi(next);
+        return 1;
+    }
+
+    mpp_err("invalid nn_cls_only\n");
+    return 0;
+}
+
+RK_S32 mpi_enc_opt_nn_full_mask(void *ctx, const char *next)
+{
+    MpiEncTestArgs *cmd = (MpiEncTestArgs *)ctx;
+
+    if (next) {
+        cmd->nn_full_mask = atoi(next);
+        return 1;
+    }
+
+    mpp_err("invalid nn_full_mask\n");
+    return 0;
+}
+
 static MppOptInfo enc_opts[] = {
     {"i",       "input_file",           "input frame file",                         mpi_enc_opt_i},
     {"o",       "output_file",          "output encoded bitstream file",            mpi_enc_opt_o},
@@ -906,6 +969,10 @@ static MppOptInfo enc_opts[] = {
     {"segmap_calc_en", "segmap_calc_en", "segmap_calc_en, 0:off 1:on",              mpi_enc_opt_segmap_calc_en},
     {"smart_en", "smart_en", "smart_en, 0:off 1:v1 3:v3",                           mpi_enc_opt_smart_en},
     {"show_time", "show_time", "show time, 0, 1, 2",                                mpi_enc_opt_show_time},
+    {"nn_max_obj", "nn_max_obj", "max objects per frame, 1~128, less for faster startup", mpi_enc_opt_nn_max_obj},
+    {"nn_cls",  "nn class list",        "wanted coco class ids, id0:id1:... max 16", mpi_enc_opt_nn_cls},
+    {"nn_cls_only", "nn_cls_only",      "decode wanted classes only, 0:off 1:on",   mpi_enc_opt_nn_cls_only},
+    {"nn_full_mask", "nn_full_mask",    "block map from full resolution mask, 0:off 1:on", mpi_enc_opt_nn_full_mask},
 };
 
 static RK_U32 enc_opt_cnt = MPP_ARRAY_ELEMS(enc_opts);
@@ -24,6 +24,8 @@
 
 typedef void* FpsCalc;
 
+#define NN_CLASS_MAX_NUM        (16) /* max classes in -nn_cls list */
+
 typedef enum {
     RUN_JPEG_RKNN = 0, /* run rknn only, input is jpeg */
     RUN_JPEG_RKNN_MPP, /* run rknn + mpp, input is jpeg */
@@ -160,6 +162,11 @@ typedef struct MpiEncTestArgs_t {
     RK_U32              rect_to_segmap_en; /* rectangle to segment map flag */
     RK_U32              smart_en; /* 0 - disable, 1 - smart v1, 3 - smart v3 */
     RK_U32              show_time; /* show time cost flag */
+    RK_S32              nn_max_obj; /* max objects kept per frame, 0 - OBJ_NUMB_MAX_SIZE */
+    RK_S32              nn_cls[NN_CLASS_MAX_NUM]; /* wanted coco class ids, empty - by yolo_scene_mode */
+    RK_S32              nn_cls_num;
+    RK_U32              nn_cls_only; /* 1 - decode wanted class score planes only */
+    RK_U32              nn_full_mask; /* 1 - block map from the input resolution mask, 0 - from the model mask */
 } MpiEncTestArgs;
 
 #ifdef __cplusplus
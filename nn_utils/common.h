@@ -11,7 +11,21 @@ typedef enum {
     IMAGE_FORMAT_RGBA8888,
     IMAGE_FORMAT_YUV420SP_NV21,
     IMAGE_FORMAT_YUV420SP_NV12,
-    IMAGE_FORMAT_YUV420P
+    IMAGE_FORMAT_YUV420P,
+    IMAGE_FORMAT_YUV422SP_NV16,
+    IMAGE_FORMAT_YUV422SP_NV61,
+    IMAGE_FORMAT_YUV422P,
+    IMAGE_FORMAT_YUV422_YUYV,
+    IMAGE_FORMAT_YUV422_YVYU,
+    IMAGE_FORMAT_YUV422_UYVY,
+    IMAGE_FORMAT_YUV422_VYUY,
+    IMAGE_FORMAT_BGR888,
+    IMAGE_FORMAT_BGRA8888,
+    IMAGE_FORMAT_ARGB8888,
+    IMAGE_FORMAT_ABGR8888,
+    IMAGE_FORMAT_RGB565,
+    IMAGE_FORMAT_BGR565,
+    IMAGE_FORMAT_BUTT
 } image_format_t;
 
 /**
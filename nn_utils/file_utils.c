@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define MAX_TEXT_LINE_LENGTH 1024
 
@@ -51,6 +55,38 @@ int read_data_from_file(const char *path, char **out_data)
     return file_size;
 }
 
+int map_data_from_file(const char *path, void **out_data)
+{
+    struct stat st;
+    void *data;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        printf("open %s fail!\n", path);
+        return -1;
+    }
+    if(fstat(fd, &st) < 0 || st.st_size <= 0) {
+        printf("stat %s fail!\n", path);
+        close(fd);
+        return -1;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    /* the mapping keeps its own reference to the file */
+    close(fd);
+    if(data == MAP_FAILED) {
+        printf("mmap %s fail!\n", path);
+        return -1;
+    }
+    *out_data = data;
+    return (int)st.st_size;
+}
+
+void unmap_data(void *data, int size)
+{
+    if(data && size > 0) {
+        munmap(data, size);
+    }
+}
+
 int write_data_to_file(const char *path, const char *data, unsigned int size)
 {
     FILE *fp;
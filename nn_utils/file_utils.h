@@ -14,6 +14,23 @@ extern "C" {
  */
 int read_data_from_file(const char *path, char **out_data);
 
+/**
+ * @brief Map file read-only into memory, no copy to heap
+ * 
+ * @param path [in] File path
+ * @param out_data [out] Mapped data, remeber call unmap_data() to release after used
+ * @return int -1: error; > 0: Mapped data size
+ */
+int map_data_from_file(const char *path, void **out_data);
+
+/**
+ * @brief Unmap data returned by map_data_from_file()
+ * 
+ * @param data [in] Mapped data
+ * @param size [in] Mapped data size
+ */
+void unmap_data(void *data, int size);
+
 /**
  * @brief Write data to file
  * 
@@ -341,9 +341,20 @@ int write_image(const char* path, const image_buffer_t* img)
     return ret;
 }
 
+/* stride in pixels, 0 means the buffer is packed without padding */
+static int get_image_wstride(image_buffer_t *image)
+{
+    return image->width_stride > 0 ? image->width_stride : image->width;
+}
+
+static int get_image_hstride(image_buffer_t *image)
+{
+    return image->height_stride > 0 ? image->height_stride : image->height;
+}
+
 static int crop_and_scale_image_c(int channel, unsigned char *src, int src_width, int src_height,
-                                    int crop_x, int crop_y, int crop_width, int crop_height,
-                                    unsigned char *dst, int dst_width, int dst_height,
+                                    int src_stride, int crop_x, int crop_y, int crop_width, int crop_height,
+                                    unsigned char *dst, int dst_wstride, int dst_hstride,
                                     int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height) {
     if (dst == NULL) {
         printf("dst buffer is null\n");
@@ -355,8 +366,8 @@ static int crop_and_scale_image_c(int channel, unsigned char *src, int src_width
 
     // printf("src_width=%d src_height=%d crop_x=%d crop_y=%d crop_width=%d crop_height=%d\n",
     //     src_width, src_height, crop_x, crop_y, crop_width, crop_height);
-    // printf("dst_width=%d dst_height=%d dst_box_x=%d dst_box_y=%d dst_box_width=%d dst_box_height=%d\n",
-    //     dst_width, dst_height, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
+    // printf("dst_wstride=%d dst_hstride=%d dst_box_x=%d dst_box_y=%d dst_box_width=%d dst_box_height=%d\n",
+    //     dst_wstride, dst_hstride, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
     // printf("channel=%d x_ratio=%f y_ratio=%f\n", channel, x_ratio, y_ratio);
 
     // 从原图指定区域取数据，双线��缩放到目标指定区域
@@ -371,11 +382,11 @@ static int crop_and_scale_image_c(int channel, unsigned char *src, int src_width
             float x_diff = (dst_x_offset * x_ratio) - (src_x - crop_x);
             float y_diff = (dst_y_offset * y_ratio) - (src_y - crop_y);
 
-            int index1 = src_y * src_width * channel + src_x * channel;
-            int index2 = index1 + src_width * channel;    // down
+            int index1 = src_y * src_stride * channel + src_x * channel;
+            int index2 = index1 + src_stride * channel;    // down
             if (src_y == src_height - 1) {
                 // 如果到图像最下边缘，变成选择上面的像約1�71ￄ1�77
-                index2 = index1 - src_width * channel;
+                index2 = index1 - src_stride * channel;
             }
             int index3 = index1 + 1 * channel;            // right
             int index4 = index2 + 1 * channel;            // down right
@@ -403,7 +414,7 @@ static int crop_and_scale_image_c(int channel, unsigned char *src, int src_width
                     D * x_diff * y_diff
                 );
 
-                dst[(dst_y * dst_width  + dst_x) * channel + c] = pixel;
+                dst[(dst_y * dst_wstride + dst_x) * channel + c] = pixel;
             }
         }
     }
@@ -412,21 +423,158 @@ static int crop_and_scale_image_c(int channel, unsigned char *src, int src_width
 }
 
 static int crop_and_scale_image_yuv420sp(unsigned char *src, int src_width, int src_height,
+                                    int src_wstride, int src_hstride,
                                     int crop_x, int crop_y, int crop_width, int crop_height,
-                                    unsigned char *dst, int dst_width, int dst_height,
+                                    unsigned char *dst, int dst_wstride, int dst_hstride,
                                     int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height) {
 
     unsigned char* src_y = src;
-    unsigned char* src_uv = src + src_width * src_height;
+    unsigned char* src_uv = src + src_wstride * src_hstride;
 
     unsigned char* dst_y = dst;
-    unsigned char* dst_uv = dst + dst_width * dst_height;
+    unsigned char* dst_uv = dst + dst_wstride * dst_hstride;
 
-    crop_and_scale_image_c(1, src_y, src_width, src_height, crop_x, crop_y, crop_width, crop_height,
-        dst_y, dst_width, dst_height, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
+    crop_and_scale_image_c(1, src_y, src_width, src_height, src_wstride, crop_x, crop_y, crop_width, crop_height,
+        dst_y, dst_wstride, dst_hstride, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
 
-    crop_and_scale_image_c(2, src_uv, src_width / 2, src_height / 2, crop_x / 2, crop_y / 2, crop_width / 2, crop_height / 2,
-        dst_uv, dst_width / 2, dst_height / 2, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
+    /* interleaved uv plane: stride counted in 2-byte uv pairs */
+    crop_and_scale_image_c(2, src_uv, src_width / 2, src_height / 2, src_wstride / 2,
+        crop_x / 2, crop_y / 2, crop_width / 2, crop_height / 2,
+        dst_uv, dst_wstride / 2, dst_hstride / 2, dst_box_x, dst_box_y, dst_box_width, dst_box_height);
+
+    return 0;
+}
+
+static inline unsigned char clip_u8(int val)
+{
+    return val < 0 ? 0 : (val > 255 ? 255 : val);
+}
+
+/* BT.601 limited range, the same as the default rga csc mode */
+static void yuv_to_rgb888(int y, int u, int v, unsigned char *rgb)
+{
+    int c = 298 * (y - 16) + 128;
+    int d = u - 128;
+    int e = v - 128;
+
+    rgb[0] = clip_u8((c + 409 * e) >> 8);
+    rgb[1] = clip_u8((c - 100 * d - 208 * e) >> 8);
+    rgb[2] = clip_u8((c + 516 * d) >> 8);
+}
+
+static void fetch_pixel_rgb888(image_buffer_t *src, int wstride, int hstride,
+                               int x, int y, unsigned char *rgb)
+{
+    unsigned char *base = src->virt_addr;
+    unsigned char *chroma = base + wstride * hstride;
+    unsigned char *p;
+    unsigned short pix;
+
+    switch (src->format) {
+    case IMAGE_FORMAT_GRAY8:
+        rgb[0] = rgb[1] = rgb[2] = base[y * wstride + x];
+        break;
+    case IMAGE_FORMAT_RGB888:
+    case IMAGE_FORMAT_BGR888: {
+        int rev = src->format == IMAGE_FORMAT_BGR888;
+
+        p = base + (y * wstride + x) * 3;
+        rgb[0] = p[rev ? 2 : 0];
+        rgb[1] = p[1];
+        rgb[2] = p[rev ? 0 : 2];
+    } break;
+    case IMAGE_FORMAT_RGBA8888:
+    case IMAGE_FORMAT_BGRA8888:
+    case IMAGE_FORMAT_ARGB8888:
+    case IMAGE_FORMAT_ABGR8888: {
+        int rev = src->format == IMAGE_FORMAT_BGRA8888 || src->format == IMAGE_FORMAT_ABGR8888;
+        int alpha_first = src->format == IMAGE_FORMAT_ARGB8888 || src->format == IMAGE_FORMAT_ABGR8888;
+
+        p = base + (y * wstride + x) * 4 + alpha_first;
+        rgb[0] = p[rev ? 2 : 0];
+        rgb[1] = p[1];
+        rgb[2] = p[rev ? 0 : 2];
+    } break;
+    case IMAGE_FORMAT_RGB565:
+    case IMAGE_FORMAT_BGR565: {
+        int rev = src->format == IMAGE_FORMAT_BGR565;
+
+        p = base + (y * wstride + x) * 2;
+        pix = p[0] | (p[1] << 8);
+        rgb[rev ? 2 : 0] = (pix >> 11) << 3;
+        rgb[1] = ((pix >> 5) & 0x3f) << 2;
+        rgb[rev ? 0 : 2] = (pix & 0x1f) << 3;
+    } break;
+    case IMAGE_FORMAT_YUV420SP_NV12:
+    case IMAGE_FORMAT_YUV420SP_NV21:
+    case IMAGE_FORMAT_YUV422SP_NV16:
+    case IMAGE_FORMAT_YUV422SP_NV61: {
+        int vu = src->format == IMAGE_FORMAT_YUV420SP_NV21 || src->format == IMAGE_FORMAT_YUV422SP_NV61;
+        int uv_y = (src->format == IMAGE_FORMAT_YUV422SP_NV16 ||
+                    src->format == IMAGE_FORMAT_YUV422SP_NV61) ? y : y / 2;
+
+        p = chroma + uv_y * wstride + (x & ~1);
+        yuv_to_rgb888(base[y * wstride + x], p[vu], p[!vu], rgb);
+    } break;
+    case IMAGE_FORMAT_YUV420P:
+    case IMAGE_FORMAT_YUV422P: {
+        int uv_y = (src->format == IMAGE_FORMAT_YUV422P) ? y : y / 2;
+        int uv_hstride = (src->format == IMAGE_FORMAT_YUV422P) ? hstride : hstride / 2;
+        int uv_pos = uv_y * (wstride / 2) + x / 2;
+
+        yuv_to_rgb888(base[y * wstride + x], chroma[uv_pos],
+                      chroma[wstride / 2 * uv_hstride + uv_pos], rgb);
+    } break;
+    case IMAGE_FORMAT_YUV422_YUYV:
+    case IMAGE_FORMAT_YUV422_YVYU:
+        p = base + (y * wstride + (x & ~1)) * 2;
+        if (src->format == IMAGE_FORMAT_YUV422_YUYV)
+            yuv_to_rgb888(p[(x & 1) * 2], p[1], p[3], rgb);
+        else
+            yuv_to_rgb888(p[(x & 1) * 2], p[3], p[1], rgb);
+        break;
+    case IMAGE_FORMAT_YUV422_UYVY:
+    case IMAGE_FORMAT_YUV422_VYUY:
+        p = base + (y * wstride + (x & ~1)) * 2;
+        if (src->format == IMAGE_FORMAT_YUV422_UYVY)
+            yuv_to_rgb888(p[1 + (x & 1) * 2], p[0], p[2], rgb);
+        else
+            yuv_to_rgb888(p[1 + (x & 1) * 2], p[2], p[0], rgb);
+        break;
+    default:
+        rgb[0] = rgb[1] = rgb[2] = 0;
+        break;
+    }
+}
+
+/* format conversion path: nearest sampling from any source format into a rgb888 target */
+static int crop_and_scale_image_to_rgb888(image_buffer_t *src, int src_wstride, int src_hstride,
+                                          int crop_x, int crop_y, int crop_width, int crop_height,
+                                          unsigned char *dst, int dst_wstride, int dst_hstride,
+                                          int dst_box_x, int dst_box_y, int dst_box_width, int dst_box_height)
+{
+    float x_ratio = (float)crop_width / (float)dst_box_width;
+    float y_ratio = (float)crop_height / (float)dst_box_height;
+
+    if (dst == NULL) {
+        printf("dst buffer is null\n");
+        return -1;
+    }
+
+    for (int dst_y = dst_box_y; dst_y < dst_box_y + dst_box_height; dst_y++) {
+        int src_y = (int)((dst_y - dst_box_y) * y_ratio) + crop_y;
+        src_y = src_y < src->height ? src_y : src->height - 1;
+        unsigned char *dst_row = dst + (dst_y * dst_wstride + dst_box_x) * 3;
+
+        for (int dst_x = dst_box_x; dst_x < dst_box_x + dst_box_width; dst_x++) {
+            int src_x = (int)((dst_x - dst_box_x) * x_ratio) + crop_x;
+
+            src_x = src_x < src->width ? src_x : src->width - 1;
+
+            fetch_pixel_rgb888(src, src_wstride, src_hstride, src_x, src_y, dst_row);
+            dst_row += 3;
+        }
+    }
 
     return 0;
 }
@@ -440,10 +588,15 @@ static int convert_image_cpu(image_buffer_t *src, image_buffer_t *dst,
     if (src->virt_addr == NULL) {
         return -1;
     }
-    if (src->format != dst->format) {
+    if (src->format != dst->format && dst->format != IMAGE_FORMAT_RGB888) {
         return -1;
     }
 
+    int src_wstride = get_image_wstride(src);
+    int src_hstride = get_image_hstride(src);
+    /* rows of a padded npu input start every dst_wstride pixels, as on the rga path */
+    int dst_wstride = get_image_wstride(dst);
+    int dst_hstride = get_image_hstride(dst);
     int src_box_x = 0;
     int src_box_y = 0;
     int src_box_w = src->width;
@@ -473,25 +626,30 @@ static int convert_image_cpu(image_buffer_t *src, image_buffer_t *dst,
 
     int need_release_dst_buffer = 0;
     int reti = 0;
-    if (src->format == IMAGE_FORMAT_RGB888) {
-        reti = crop_and_scale_image_c(3, src->virt_addr, src->width, src->height,
+    if (src->format != dst->format) {
+        reti = crop_and_scale_image_to_rgb888(src, src_wstride, src_hstride,
+            src_box_x, src_box_y, src_box_w, src_box_h,
+            dst->virt_addr, dst_wstride, dst_hstride,
+            dst_box_x, dst_box_y, dst_box_w, dst_box_h);
+    } else if (src->format == IMAGE_FORMAT_RGB888) {
+        reti = crop_and_scale_image_c(3, src->virt_addr, src->width, src->height, src_wstride,
             src_box_x, src_box_y, src_box_w, src_box_h,
-            dst->virt_addr, dst->width, dst->height,
+            dst->virt_addr, dst_wstride, dst_hstride,
             dst_box_x, dst_box_y, dst_box_w, dst_box_h);
     } else if (src->format == IMAGE_FORMAT_RGBA8888) {
-        reti = crop_and_scale_image_c(4, src->virt_addr, src->width, src->height,
+        reti = crop_and_scale_image_c(4, src->virt_addr, src->width, src->height, src_wstride,
             src_box_x, src_box_y, src_box_w, src_box_h,
-            dst->virt_addr, dst->width, dst->height,
+            dst->virt_addr, dst_wstride, dst_hstride,
             dst_box_x, dst_box_y, dst_box_w, dst_box_h);
     } else if (src->format == IMAGE_FORMAT_GRAY8) {
-        reti = crop_and_scale_image_c(1, src->virt_addr, src->width, src->height,
+        reti = crop_and_scale_image_c(1, src->virt_addr, src->width, src->height, src_wstride,
             src_box_x, src_box_y, src_box_w, src_box_h,
-            dst->virt_addr, dst->width, dst->height,
+            dst->virt_addr, dst_wstride, dst_hstride,
             dst_box_x, dst_box_y, dst_box_w, dst_box_h);
     } else if (src->format == IMAGE_FORMAT_YUV420SP_NV12 || src->format == IMAGE_FORMAT_YUV420SP_NV21) {
         reti = crop_and_scale_image_yuv420sp(src->virt_addr, src->width, src->height,
-            src_box_x, src_box_y, src_box_w, src_box_h,
-            dst->virt_addr, dst->width, dst->height,
+            src_wstride, src_hstride, src_box_x, src_box_y, src_box_w, src_box_h,
+            dst->virt_addr, dst_wstride, dst_hstride,
             dst_box_x, dst_box_y, dst_box_w, dst_box_h);
     } else {
         printf("no support format %d\n", src->format);
@@ -510,16 +668,44 @@ static int convert_image_cpu(image_buffer_t *src, image_buffer_t *dst,
 static int get_rga_fmt(image_format_t fmt) {
     switch (fmt)
     {
+    case IMAGE_FORMAT_GRAY8:
+        return RK_FORMAT_YCbCr_400;
     case IMAGE_FORMAT_RGB888:
         return RK_FORMAT_RGB_888;
+    case IMAGE_FORMAT_BGR888:
+        return RK_FORMAT_BGR_888;
     case IMAGE_FORMAT_RGBA8888:
         return RK_FORMAT_RGBA_8888;
+    case IMAGE_FORMAT_BGRA8888:
+        return RK_FORMAT_BGRA_8888;
+    case IMAGE_FORMAT_ARGB8888:
+        return RK_FORMAT_ARGB_8888;
+    case IMAGE_FORMAT_ABGR8888:
+        return RK_FORMAT_ABGR_8888;
+    case IMAGE_FORMAT_RGB565:
+        return RK_FORMAT_RGB_565;
+    case IMAGE_FORMAT_BGR565:
+        return RK_FORMAT_BGR_565;
     case IMAGE_FORMAT_YUV420SP_NV12:
         return RK_FORMAT_YCbCr_420_SP;
     case IMAGE_FORMAT_YUV420SP_NV21:
         return RK_FORMAT_YCrCb_420_SP;
     case IMAGE_FORMAT_YUV420P:
         return RK_FORMAT_YCbCr_420_P;
+    case IMAGE_FORMAT_YUV422SP_NV16:
+        return RK_FORMAT_YCbCr_422_SP;
+    case IMAGE_FORMAT_YUV422SP_NV61:
+        return RK_FORMAT_YCrCb_422_SP;
+    case IMAGE_FORMAT_YUV422P:
+        return RK_FORMAT_YCbCr_422_P;
+    case IMAGE_FORMAT_YUV422_YUYV:
+        return RK_FORMAT_YUYV_422;
+    case IMAGE_FORMAT_YUV422_YVYU:
+        return RK_FORMAT_YVYU_422;
+    case IMAGE_FORMAT_YUV422_UYVY:
+        return RK_FORMAT_UYVY_422;
+    case IMAGE_FORMAT_YUV422_VYUY:
+        return RK_FORMAT_VYUY_422;
     default:
         return -1;
     }
@@ -527,25 +713,61 @@ static int get_rga_fmt(image_format_t fmt) {
 
 int get_image_size(image_buffer_t* image)
 {
+    int wstride, hstride;
+
     if (image == NULL) {
         return 0;
     }
+
+    wstride = get_image_wstride(image);
+    hstride = get_image_hstride(image);
     switch (image->format)
     {
     case IMAGE_FORMAT_GRAY8:
-        return image->width * image->height;
+        return wstride * hstride;
     case IMAGE_FORMAT_RGB888:
-        return image->width * image->height * 3;
+        return wstride * hstride * 3;
     case IMAGE_FORMAT_RGBA8888:
-        return image->width * image->height * 4;
+        return wstride * hstride * 4;
     case IMAGE_FORMAT_YUV420SP_NV12:
     case IMAGE_FORMAT_YUV420SP_NV21:
-        return image->width * image->height * 3 / 2;
+    case IMAGE_FORMAT_YUV420P:
+        return wstride * hstride * 3 / 2;
+    case IMAGE_FORMAT_YUV422SP_NV16:
+    case IMAGE_FORMAT_YUV422SP_NV61:
+    case IMAGE_FORMAT_YUV422P:
+        return wstride * hstride * 2;
     default:
         break;
     }
 
-    return 0;
+    return wstride * hstride * get_image_plane_bpp(image->format);
+}
+
+int get_image_plane_bpp(image_format_t format)
+{
+    switch (format)
+    {
+    case IMAGE_FORMAT_RGB888:
+    case IMAGE_FORMAT_BGR888:
+        return 3;
+    case IMAGE_FORMAT_RGBA8888:
+    case IMAGE_FORMAT_BGRA8888:
+    case IMAGE_FORMAT_ARGB8888:
+    case IMAGE_FORMAT_ABGR8888:
+        return 4;
+    case IMAGE_FORMAT_YUV422_YUYV:
+    case IMAGE_FORMAT_YUV422_YVYU:
+    case IMAGE_FORMAT_YUV422_UYVY:
+    case IMAGE_FORMAT_YUV422_VYUY:
+    case IMAGE_FORMAT_RGB565:
+    case IMAGE_FORMAT_BGR565:
+        return 2;
+    default:
+        break;
+    }
+
+    return 1;
 }
 
 static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img,
@@ -555,6 +777,8 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img,
     RK_S64 time_start, time_end;
     int srcWidth = src_img->width;
     int srcHeight = src_img->height;
+    int srcWStride = get_image_wstride(src_img);
+    int srcHStride = get_image_hstride(src_img);
     void *src = src_img->virt_addr;
     int src_fd = src_img->fd;
     void *src_phy = NULL;
@@ -562,11 +786,18 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img,
 
     int dstWidth = dst_img->width;
     int dstHeight = dst_img->height;
+    int dstWStride = get_image_wstride(dst_img);
+    int dstHStride = get_image_hstride(dst_img);
     void *dst = dst_img->virt_addr;
     int dst_fd = dst_img->fd;
     void *dst_phy = NULL;
     int dstFmt = get_rga_fmt(dst_img->format);
 
+    if (srcFmt < 0 || dstFmt < 0) {
+        mpp_err_f("rga not support format src %d dst %d\n", src_img->format, dst_img->format);
+        return -1;
+    }
+
     int rotate = 0;
     int use_handle = 0;
 #if defined(LIBRGA_IM2D_HANDLE)
@@ -617,13 +848,13 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img,
     memset(&pat, 0, sizeof(rga_buffer_t));
 
     im_handle_param_t in_param;
-    in_param.width = srcWidth;
-    in_param.height = srcHeight;
+    in_param.width = srcWStride;
+    in_param.height = srcHStride;
     in_param.format = srcFmt;
 
     im_handle_param_t dst_param;
-    dst_param.width = dstWidth;
-    dst_param.height = dstHeight;
+    dst_param.width = dstWStride;
+    dst_param.height = dstHStride;
     dst_param.format = dstFmt;
 
     time_start = mpp_time();
@@ -635,7 +866,7 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img,
             goto err;
         }
 
-        rga_buf_src = wrapbuffer_handle(rga_handle_src, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
+        rga_buf_src = wrapbuffer_handle(rga_handle_src, srcWidth, srcHeight, srcFmt, srcWStride, srcHStride);
     } else if (use_handle) {
         if (src_phy != NULL) {
             rga_handle_src = importbuffer_physicaladdr((uint64_t)src_phy, &in_param);
@@ -649,14 +880,14 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img,
             ret = -1;
             goto err;
         }
-        rga_buf_src = wrapbuffer_handle(rga_handle_src, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
+        rga_buf_src = wrapbuffer_handle(rga_handle_src, srcWidth, srcHeight, srcFmt, srcWStride, srcHStride);
     } else {
         if (src_phy != NULL) {
-            rga_buf_src = wrapbuffer_physicaladdr(src_phy, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
+            rga_buf_src = wrapbuffer_physicaladdr(src_phy, srcWidth, srcHeight, srcFmt, srcWStride, srcHStride);
         } else if (src_fd > 0) {
-            rga_buf_src = wrapbuffer_fd(src_fd, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
+            rga_buf_src = wrapbuffer_fd(src_fd, srcWidth, srcHeight, srcFmt, srcWStride, srcHStride);
         } else {
-            rga_buf_src = wrapbuffer_virtualaddr(src, srcWidth, srcHeight, srcFmt, srcWidth, srcHeight);
+            rga_buf_src = wrapbuffer_virtualaddr(src, srcWidth, srcHeight, srcFmt, srcWStride, srcHStride);
         }
     }
 
@@ -668,7 +899,7 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img,
             goto err;
         }
 
-        rga_buf_dst = wrapbuffer_handle(rga_handle_dst, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
+        rga_buf_dst = wrapbuffer_handle(rga_handle_dst, dstWidth, dstHeight, dstFmt, dstWStride, dstHStride);
     } else if (use_handle) {
         if (dst_phy != NULL) {
             rga_handle_dst = importbuffer_physicaladdr((uint64_t)dst_phy, &dst_param);
@@ -682,14 +913,14 @@ static int convert_image_rga(image_buffer_t* src_img, image_buffer_t* dst_img,
             ret = -1;
             goto err;
         }
-        rga_buf_dst = wrapbuffer_handle(rga_handle_dst, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
+        rga_buf_dst = wrapbuffer_handle(rga_handle_dst, dstWidth, dstHeight, dstFmt, dstWStride, dstHStride);
     } else {
         if (dst_phy != NULL) {
-            rga_buf_dst = wrapbuffer_physicaladdr(dst_phy, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
+            rga_buf_dst = wrapbuffer_physicaladdr(dst_phy, dstWidth, dstHeight, dstFmt, dstWStride, dstHStride);
         } else if (dst_fd > 0) {
-            rga_buf_dst = wrapbuffer_fd(dst_fd, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
+            rga_buf_dst = wrapbuffer_fd(dst_fd, dstWidth, dstHeight, dstFmt, dstWStride, dstHStride);
         } else {
-            rga_buf_dst = wrapbuffer_virtualaddr(dst, dstWidth, dstHeight, dstFmt, dstWidth, dstHeight);
+            rga_buf_dst = wrapbuffer_virtualaddr(dst, dstWidth, dstHeight, dstFmt, dstWStride, dstHStride);
         }
     }
     time_end = mpp_time();
@@ -66,6 +66,14 @@ int convert_image_with_letterbox(image_buffer_t* src_image, image_buffer_t* dst_
  */
 int get_image_size(image_buffer_t* image);
 
+/**
+ * @brief Get the bytes per pixel of the first image plane
+ * 
+ * @param format [in] Image format
+ * @return int bytes per pixel, used to turn a byte stride into a pixel stride
+ */
+int get_image_plane_bpp(image_format_t format);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
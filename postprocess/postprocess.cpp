@@ -12,13 +12,16 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <assert.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
-#include "opencv2/opencv.hpp"
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 #include "im2d.hpp"
 // #include "dma_alloc.hpp"
@@ -29,16 +32,21 @@
 #include "mpp_log.h"
 #include "mpp_common.h"
 
-#include <set>
-#include <vector>
+#include <unistd.h>
 #define LABEL_NALE_TXT_PATH "./model/coco_80_labels_list.txt"
 
+#define DECODE_HEAD_NUM     (3)  /* detection heads of stride 8/16/32, the proto output follows them */
+
 #ifndef RV1126B_ARMHF
 #define ENABLE_NEON
 #define ENABLE_MATMUL_OPT /* dynamic shape */
 #define ENABLE_MASK_MERGE
 #endif
 
+#if defined(ENABLE_MASK_MERGE) && !defined(USE_FP_MASK_MAP)
+#define ENABLE_MASK_BITS /* the merged 0/1 mask is kept as a bitset, see RknnCtx.mask_bits */
+#endif
+
 #define POST_DBG_FUNCTION             (0x00000001)
 #define POST_DBG_DETAIL               (0x00000002)
 #define POST_DBG_DETECT_RECT          (0x00000004)
@@ -64,8 +72,17 @@ const int anchor[3][6] = {{10, 13, 16, 30, 33, 23},
                           {30, 61, 62, 45, 59, 119},
                           {116, 90, 156, 198, 373, 326}};
 
-/* 0 - person; 1 - bicycle; 2 - car */
-const int yolo_to_rk_class[8] = { 0, 1, 2, 1, -1, 2, -1, 2 };
+#define RK_CLASS_OTHER      (3)  /* wanted classes without a class of their own */
+
+/* 0 - person; 1 - bicycle; 2 - car; 3 - other */
+const int yolo_to_rk_class[8] = { 0, 1, 2, 1, RK_CLASS_OTHER, 2, RK_CLASS_OTHER, 2 };
+
+/* classes beyond the table come from -nn_cls, they are the generic foreground class other */
+static int to_rk_class(int cls_id)
+{
+    return (cls_id >= 0 && cls_id < (int)MPP_ARRAY_ELEMS(yolo_to_rk_class)) ?
+           yolo_to_rk_class[cls_id] : RK_CLASS_OTHER;
+}
 
 int clamp(float val, int min, int max)
 {
@@ -139,122 +156,52 @@ static int loadLabelName(const char *locationFilename, char *label[])
     return 0;
 }
 
-static float CalculateOverlap(float xmin0, float ymin0, float xmax0, float ymax0, float xmin1, float ymin1, float xmax1,
-                              float ymax1)
-{
-    float w = fmax(0.f, fmin(xmax0, xmax1) - fmax(xmin0, xmin1) + 1.0);
-    float h = fmax(0.f, fmin(ymax0, ymax1) - fmax(ymin0, ymin1) + 1.0);
-    float i = w * h;
-    float u = (xmax0 - xmin0 + 1.0) * (ymax0 - ymin0 + 1.0) + (xmax1 - xmin1 + 1.0) * (ymax1 - ymin1 + 1.0) - i;
-    return u <= 0.f ? 0.f : (i / u);
-}
-
-static int nms(int validCount, std::vector<float> &outputLocations, std::vector<int> classIds, std::vector<int> &order,
-               int filterId, float threshold)
+/* a comes before b in score order, ties keep the decode order */
+static inline int cand_before(const float *probs, int a, int b)
 {
-    for (int i = 0; i < validCount; ++i)
-    {
-        if (order[i] == -1 || classIds[i] != filterId)
-        {
-            continue;
-        }
-        int n = order[i];
-        for (int j = i + 1; j < validCount; ++j)
-        {
-            int m = order[j];
-            if (m == -1 || classIds[i] != filterId)
-            {
-                continue;
-            }
-            float xmin0 = outputLocations[n * 4 + 0];
-            float ymin0 = outputLocations[n * 4 + 1];
-            float xmax0 = outputLocations[n * 4 + 0] + outputLocations[n * 4 + 2];
-            float ymax0 = outputLocations[n * 4 + 1] + outputLocations[n * 4 + 3];
-
-            float xmin1 = outputLocations[m * 4 + 0];
-            float ymin1 = outputLocations[m * 4 + 1];
-            float xmax1 = outputLocations[m * 4 + 0] + outputLocations[m * 4 + 2];
-            float ymax1 = outputLocations[m * 4 + 1] + outputLocations[m * 4 + 3];
-
-            float iou = CalculateOverlap(xmin0, ymin0, xmax0, ymax0, xmin1, ymin1, xmax1, ymax1);
-
-            if (iou > threshold)
-            {
-                order[j] = -1;
-            }
-        }
-    }
-    return 0;
+    return probs[a] > probs[b] || (probs[a] == probs[b] && a < b);
 }
 
-static int quick_sort_indice_inverse(std::vector<float> &input, int left, int right, std::vector<int> &indices)
+static void cand_heap_sift_down(const float *probs, int *heap, int num, int pos)
 {
-    float key;
-    int key_index;
-    int low = left;
-    int high = right;
+    int top = heap[pos];
 
-    post_dbg_func("enter\n");
+    while (1) {
+        int child = pos * 2 + 1;
 
-    if (left < right)
-    {
-        key_index = indices[left];
-        key = input[left];
-        while (low < high)
-        {
-            while (low < high && input[high] <= key)
-            {
-                high--;
-            }
-            input[low] = input[high];
-            indices[low] = indices[high];
-            while (low < high && input[low] >= key)
-            {
-                low++;
-            }
-            input[high] = input[low];
-            indices[high] = indices[low];
-        }
-        input[low] = key;
-        indices[low] = key_index;
-        quick_sort_indice_inverse(input, left, low - 1, indices);
-        quick_sort_indice_inverse(input, low + 1, right, indices);
+        if (child >= num)
+            break;
+        if (child + 1 < num && cand_before(probs, heap[child + 1], heap[child]))
+            child++;
+        if (!cand_before(probs, heap[child], top))
+            break;
+        heap[pos] = heap[child];
+        pos = child;
     }
-
-    post_dbg_func("exit\n");
-
-    return low;
+    heap[pos] = top;
 }
 
-static void resize_by_opencv_fp(float *input_image, int input_width, int input_height, int boxes_num, float *output_image, int target_width, int target_height)
+/* heapify the candidate indices in O(n), the best candidate is at heap[0] */
+static void cand_heap_build(const float *probs, int *heap, int num)
 {
-    post_dbg_func("enter\n");
-
-    for (int b = 0; b < boxes_num; b++)
-    {
-        cv::Mat src_image(input_height, input_width, CV_32F, &input_image[b * input_width * input_height]);
-        cv::Mat dst_image;
-        cv::resize(src_image, dst_image, cv::Size(target_width, target_height), 0, 0, cv::INTER_LINEAR);
-        memcpy(&output_image[b * target_width * target_height], dst_image.data, target_width * target_height * sizeof(float));
-    }
-
-    post_dbg_func("exit\n");
+    for (int i = 0; i < num; i++)
+        heap[i] = i;
+    for (int i = num / 2 - 1; i >= 0; i--)
+        cand_heap_sift_down(probs, heap, num, i);
 }
 
-static void resize_by_opencv_uint8(uint8_t *input_image, int input_width, int input_height,
-                            int boxes_num, uint8_t *output_image, int target_width, int target_height)
+/* take out the best candidate left in O(log n) */
+static int cand_heap_pop(const float *probs, int *heap, int *num)
 {
-    post_dbg_func("enter\n");
+    int top = heap[0];
 
-    for (int b = 0; b < boxes_num; b++) {
-        cv::Mat src_image(input_height, input_width, CV_8U, &input_image[b * input_width * input_height]);
-        cv::Mat dst_image;
-        cv::resize(src_image, dst_image, cv::Size(target_width, target_height), 0, 0, cv::INTER_LINEAR);
-        memcpy(&output_image[b * target_width * target_height],
-               dst_image.data, target_width * target_height * sizeof(uint8_t));
+    (*num)--;
+    if (*num > 0) {
+        heap[0] = heap[*num];
+        cand_heap_sift_down(probs, heap, *num, 0);
     }
 
-    post_dbg_func("exit\n");
+    return top;
 }
 
 // void resize_by_rga_rk3588(uint8_t *input_image, int input_width, int input_height,
@@ -322,110 +269,41 @@ public:
 };
 
 
-static void crop_mask_fp(float *seg_mask, uint8_t *all_mask_in_one, float *boxes, int boxes_num,
-                         int *cls_id, int height, int width, int scene_mode)
-{
-    post_dbg_func("enter\n");
-
-    for (int b = 0; b < boxes_num; b++) {
-        float x1 = boxes[b * 4 + 0];
-        float y1 = boxes[b * 4 + 1];
-        float x2 = boxes[b * 4 + 2];
-        float y2 = boxes[b * 4 + 3];
-
-        // convert yolo class to rk class
-        if (scene_mode == 0) {
-            /* 0: person 1: book */
-            cls_id[b] = cls_id[b] == LABEL_BOOK;
-        } else {
-            cls_id[b] = yolo_to_rk_class[cls_id[b]];
-        }
-
-        for (int i = 0; i < height; i++) {
-            for (int j = 0; j < width; j++) {
-                if (j >= x1 && j < x2 && i >= y1 && i < y2) {
-                    if (all_mask_in_one[i * width + j] == 0) {
-                        if (seg_mask[b * width * height + i * width + j] > 0) {
-                            all_mask_in_one[i * width + j] = (cls_id[b] + 1);
-                        } else {
-                            all_mask_in_one[i * width + j] = 0;
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    post_dbg_func("exit\n");
-}
-
-#ifdef ENABLE_MASK_MERGE
-static void crop_mask_uint8_merge(uint8_t *seg_mask, uint8_t *all_mask_in_one, float *boxes,
-                     int boxes_num, int *cls_id, int height, int width, int scene_mode)
+/* pixels of a box on the model input, right and bottom exclusive, may be empty */
+static image_rect_t box_pixel_rect(const float *box, int width, int height)
 {
-    int i, b, j, k;
+    image_rect_t r;
 
-    post_dbg_func("enter\n");
-
-    for (int b = 0; b < boxes_num; b++) {
-        float x1 = boxes[b * 4 + 0];
-        float y1 = boxes[b * 4 + 1];
-        float x2 = boxes[b * 4 + 2];
-        float y2 = boxes[b * 4 + 3];
-
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                if (j >= x1 && j < x2 && i >= y1 && i < y2 &&
-                    all_mask_in_one[i * width + j] == 0) {
-                    all_mask_in_one[i * width + j] = seg_mask[i * width + j] > 0;
-                }
-            }
-        }
-    }
+    /* box corners are whole pixels, j >= x1 && j < x2 */
+    r.left = MPP_MAX((int)box[0], 0);
+    r.top = MPP_MAX((int)box[1], 0);
+    r.right = MPP_MIN((int)box[2], width);
+    r.bottom = MPP_MIN((int)box[3], height);
 
-    post_dbg_func("exit\n");
+    return r;
 }
-#endif
 
-static void crop_mask_uint8(uint8_t *seg_mask, uint8_t *all_mask_in_one, float *boxes,
-                     int boxes_num, int *cls_id, int height, int width, int scene_mode)
+/*
+ * Cells of the proto grid a box needs, bilinear taps of the box pixels stay
+ * inside with one cell of margin, right and bottom exclusive, may be empty.
+ */
+static image_rect_t proto_footprint(image_rect_t px, int sx, int sy)
 {
-    int i, b, j, k;
-
-    post_dbg_func("enter\n");
+    image_rect_t r;
 
-    for (int b = 0; b < boxes_num; b++) {
-        float x1 = boxes[b * 4 + 0];
-        float y1 = boxes[b * 4 + 1];
-        float x2 = boxes[b * 4 + 2];
-        float y2 = boxes[b * 4 + 3];
-
-        // convert yolo class to rk class
-        if (scene_mode == 0) {
-            /* 0: person 1: book */
-            cls_id[b] = cls_id[b] == LABEL_BOOK;
-        } else {
-            cls_id[b] = yolo_to_rk_class[cls_id[b]];
-        }
-
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                if (j >= x1 && j < x2 && i >= y1 && i < y2) {
-                    if (all_mask_in_one[i * width + j] == 0) {
-                        if (seg_mask[b * width * height + i * width + j] > 0) {
-                            // add one for each class
-                            all_mask_in_one[i * width + j] = (cls_id[b] + 1);
-                        }
-                    }
-                }
-            }
-        }
+    if (px.left >= px.right || px.top >= px.bottom) {
+        memset(&r, 0, sizeof(r));
+        return r;
     }
+    r.left = MPP_MAX(px.left / sx - 1, 0);
+    r.top = MPP_MAX(px.top / sy - 1, 0);
+    r.right = MPP_MIN((px.right + sx - 1) / sx + 1, PROTO_WEIGHT);
+    r.bottom = MPP_MIN((px.bottom + sy - 1) / sy + 1, PROTO_HEIGHT);
 
-    post_dbg_func("exit\n");
+    return r;
 }
 
-static void matmul_by_cpu_fp(std::vector<float> &A, float *B, float *C, int ROWS_A, int COLS_A, int COLS_B)
+static void matmul_by_cpu_fp(const float *A, float *B, float *C, int ROWS_A, int COLS_A, int COLS_B)
 {
     float temp = 0;
 
@@ -447,7 +325,9 @@ static void matmul_by_cpu_fp(std::vector<float> &A, float *B, float *C, int ROWS
     post_dbg_func("exit\n");
 }
 
-static void matmul_by_cpu_uint8(std::vector<float> &A, float *B, uint8_t *C, int ROWS_A, int COLS_A, int COLS_B)
+/* only the footprint of each row (box) on the proto grid is computed */
+static void matmul_by_cpu_uint8(const float *A, float *B, uint8_t *C, int ROWS_A, int COLS_A, int COLS_B,
+                                const image_rect_t *rect)
 {
     float temp = 0;
     int index_A, index_C;
@@ -458,16 +338,78 @@ static void matmul_by_cpu_uint8(std::vector<float> &A, float *B, uint8_t *C, int
     {
         index_A = i * COLS_A;
         index_C = i * COLS_B;
-        for (int j = 0; j < COLS_B; j++)
+        for (int y = rect[i].top; y < rect[i].bottom; y++)
         {
-            temp = 0;
-            for (int k = 0; k < COLS_A; k++)
+            for (int j = y * PROTO_WEIGHT + rect[i].left; j < y * PROTO_WEIGHT + rect[i].right; j++)
             {
-                temp += A[index_A + k] * B[k * COLS_B + j];
+                temp = 0;
+                for (int k = 0; k < COLS_A; k++)
+                {
+                    temp += A[index_A + k] * B[k * COLS_B + j];
+                }
+                C[index_C + j] = temp > 0;
             }
-            if (temp > 0)
-            {
-                C[index_C + j] = 4;
+        }
+    }
+
+    post_dbg_func("exit\n");
+}
+
+/* dot product of 32 int8 */
+static inline int32_t dot_i8x32(const int8_t *a, const int8_t *b)
+{
+#if defined(__ARM_FEATURE_DOTPROD)
+    int32x4_t acc = vdotq_s32(vdupq_n_s32(0), vld1q_s8(a), vld1q_s8(b));
+
+    acc = vdotq_s32(acc, vld1q_s8(a + 16), vld1q_s8(b + 16));
+    return vaddvq_s32(acc);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int32x4_t acc = vdupq_n_s32(0);
+
+    for (int k = 0; k < 32; k += 8)
+        acc = vpadalq_s16(acc, vmull_s8(vld1_s8(a + k), vld1_s8(b + k)));
+
+    int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    return vget_lane_s32(vpadd_s32(sum, sum), 0);
+#else
+    int32_t sum = 0;
+
+    for (int k = 0; k < 32; k++)
+        sum += a[k] * b[k];
+    return sum;
+#endif
+}
+
+/*
+ * Sign of the coefficient x proto product in the quantised domain.
+ * A is [M][32] int8 with a zero point per row, B is the proto transposed to
+ * [N][32] int8 with zero point zb and the channel sum of each pixel in b_sum.
+ * sum (a - za)(b - zb) = a.b - zb * sum(a) - za * sum(b) + 32 * za * zb
+ * C[i][j] is 1 if it is > 0, 0 otherwise, only inside the proto footprint
+ * of row i, the rest of the row is left as is.
+ */
+static void matmul_sign_i8(const int8_t *A, const int32_t *za, const int8_t *B, const int32_t *b_sum,
+                           int32_t zb, uint8_t *C, int M, int N, const image_rect_t *rect)
+{
+    post_dbg_func("enter\n");
+
+    for (int i = 0; i < M; i++) {
+        const int8_t *a = A + i * PROTO_CHANNEL;
+        uint8_t *c = C + i * N;
+        int32_t a_sum = 0;
+
+        for (int k = 0; k < PROTO_CHANNEL; k++)
+            a_sum += a[k];
+
+        int32_t bias = PROTO_CHANNEL * za[i] * zb - zb * a_sum;
+
+        for (int y = rect[i].top; y < rect[i].bottom; y++) {
+            int row_end = y * PROTO_WEIGHT + rect[i].right;
+
+            for (int j = y * PROTO_WEIGHT + rect[i].left; j < row_end; j++) {
+                int32_t v = dot_i8x32(a, B + j * PROTO_CHANNEL) - za[i] * b_sum[j] + bias;
+
+                c[j] = v > 0;
             }
         }
     }
@@ -475,7 +417,7 @@ static void matmul_by_cpu_uint8(std::vector<float> &A, float *B, uint8_t *C, int
     post_dbg_func("exit\n");
 }
 
-static void matmul_by_npu_fp(std::vector<float> &A_input, float *B_input, float *C_input,
+static void matmul_by_npu_fp(const float *A_input, float *B_input, float *C_input,
                              int ROWS_A, int COLS_A, int COLS_B, RknnCtx *nn_ctx)
 {
     int B_layout = 0;
@@ -547,7 +489,7 @@ static void matmul_by_npu_fp(std::vector<float> &A_input, float *B_input, float
     post_dbg_func("exit\n");
 }
 
-static int matmul_by_npu_fp_optimized(std::vector<float> &A_input,
+static int matmul_by_npu_fp_optimized(const float *A_input,
 #ifdef USE_FP_MASK_MAP
                                       float *C_input,
 #else
@@ -563,7 +505,7 @@ static int matmul_by_npu_fp_optimized(std::vector<float> &A_input,
 
     post_dbg_func("enter\n");
 
-    assert(ROWS_A <= OBJ_NUMB_MAX_SIZE);
+    assert(ROWS_A <= nn_ctx->max_obj_num);
     timer.tik();
     ret = rknn_matmul_set_dynamic_shape(mat_ctx, &nn_ctx->shapes[tensor_idx]);
     if (ret != 0) {
@@ -597,67 +539,66 @@ static int matmul_by_npu_fp_optimized(std::vector<float> &A_input,
     ret = rknn_matmul_run(mat_ctx);
     post_dbg_time("3 - rknn_matmul_run");
 
+#if defined(ENABLE_MASK_MERGE) && !defined(USE_FP_MASK_MAP)
     timer.tik();
-#ifdef USE_FP_MASK_MAP
-    memcpy(C_input, nn_ctx->tensor_c->virt_addr, io_attr->C.size);
-#else
     int tensor_c_len = io_attr->C.size / sizeof(float);
     // mpp_log("matrix C len: %d\n", tensor_c_len);
-#ifdef ENABLE_MASK_MERGE
-    int boxes_num = ROWS_A;
-    int tensor_merge_len = tensor_c_len / boxes_num;
-    float merge_c_result = 0;
-
-    // mpp_log("boxes_num: %d, tensor_merge_len: %d\n", boxes_num, tensor_merge_len);
-    for (int i = 0; i < tensor_merge_len; ++i) {
-        merge_c_result = 0;
-        for (int j = 0; j < boxes_num; ++j) {
-            merge_c_result += ((float *)nn_ctx->tensor_c->virt_addr)[j * tensor_merge_len + i] > 0;
-            // mpp_log("merge_c_result: %f\n", merge_c_result);
+    int plane_len = tensor_c_len / ROWS_A;
+
+    /* one merged plane, each box only marks its own footprint */
+    memset(C_input, 0, plane_len * sizeof(uint8_t));
+    for (int b = 0; b < ROWS_A; ++b) {
+        const float *c = (const float *)nn_ctx->tensor_c->virt_addr + b * plane_len;
+        const image_rect_t *r = &nn_ctx->proto_rect[b];
+
+        for (int y = r->top; y < r->bottom; y++) {
+            for (int x = y * PROTO_WEIGHT + r->left; x < y * PROTO_WEIGHT + r->right; x++) {
+                if (c[x] > 0)
+                    C_input[x] = 1;
+            }
         }
-        C_input[i] = merge_c_result > 0 ? 4 : 0;
     }
+    post_dbg_time("3 - C_input: matmul output merge");
 #else
-    for (int i = 0; i < tensor_c_len; ++i)
-        C_input[i] = ((float *)nn_ctx->tensor_c->virt_addr)[i] > 0 ? 4 : 0;
-#endif
+    /* tensor_c keeps every box, box_proto_mask() reads them one at a time */
+    (void)C_input;
 #endif
-    post_dbg_time("3 - C_input: matmul output copy");
     post_dbg_func("exit\n");
 
     return ret;
 }
 
-static void seg_reverse(uint8_t *seg_mask, uint8_t *cropped_seg, uint8_t *seg_mask_real,
-                 int model_in_height, int model_in_width, int cropped_height,
-                 int cropped_width, int ori_in_height, int ori_in_width, int y_pad, int x_pad)
+/*
+ * Model mask at the input resolution, nearest neighbour through the letterbox
+ * inverse tables proj_x/proj_y so class ids are never blended. Input rows on
+ * the same model row are copied.
+ */
+static void seg_reverse(RknnCtx *nn_ctx, uint8_t *seg_mask_real, int ori_in_height, int ori_in_width)
 {
+    const uint16_t *proj_x = nn_ctx->proj_x;
+
     post_dbg_func("enter\n");
 
-    if (y_pad == 0 && x_pad == 0 && ori_in_height == model_in_height && ori_in_width == model_in_width)
-    {
-        memcpy(seg_mask_real, seg_mask, ori_in_height * ori_in_width);
-        return;
-    }
+    for (int y = 0; y < ori_in_height; y++) {
+        uint8_t *dst = seg_mask_real + y * ori_in_width;
 
-    int cropped_index = 0;
-    for (int i = 0; i < model_in_height; i++)
-    {
-        for (int j = 0; j < model_in_width; j++)
-        {
-            if (i >= y_pad && i < model_in_height - y_pad && j >= x_pad && j < model_in_width - x_pad)
-            {
-                int seg_index = i * model_in_width + j;
-                cropped_seg[cropped_index] = seg_mask[seg_index];
-                cropped_index++;
-            }
+        if (y > 0 && nn_ctx->proj_y[y] == nn_ctx->proj_y[y - 1]) {
+            memcpy(dst, dst - ori_in_width, ori_in_width);
+            continue;
         }
+
+#ifdef ENABLE_MASK_BITS
+        const uint64_t *src = nn_ctx->mask_bits + nn_ctx->proj_y[y] * nn_ctx->mask_bits_stride;
+
+        for (int x = 0; x < ori_in_width; x++)
+            dst[x] = (src[proj_x[x] >> 6] >> (proj_x[x] & 63)) & 1;
+#else
+        const uint8_t *src = nn_ctx->all_mask_in_one + nn_ctx->proj_y[y] * nn_ctx->model_width;
+
+        for (int x = 0; x < ori_in_width; x++)
+            dst[x] = src[proj_x[x]];
+#endif
     }
-    // Note: Here are different methods provided for implementing single-channel image scaling.
-    //       The method of using rga to resize the image requires that the image size is 2 aligned.
-    resize_by_opencv_uint8(cropped_seg, cropped_width, cropped_height, 1, seg_mask_real, ori_in_width, ori_in_height);
-    // resize_by_rga_rk356x(cropped_seg, cropped_width, cropped_height, seg_mask_real, ori_in_width, ori_in_height);
-    // resize_by_rga_rk3588(cropped_seg, cropped_width, cropped_height, seg_mask_real, ori_in_width, ori_in_height);
 
     post_dbg_func("exit\n");
 }
@@ -690,8 +631,6 @@ static float deqnt_affine_to_f32(int8_t qnt, int32_t zp, float scale)
 }
 
 #ifdef ENABLE_NEON
-#include <arm_neon.h>
-
 void convert_neon(const float* src, uint16_t* dst, int n) {
     for (int i = 0; i < n; i += 4) {
         float32x4_t f32 = vld1q_f32(src + i);
@@ -701,39 +640,458 @@ void convert_neon(const float* src, uint16_t* dst, int n) {
 }
 #endif
 
-static int process_i8(rknn_output *all_input, int input_id, int *anchor,
-                      int grid_h, int grid_w, int height, int width, int stride,
-                      std::vector<float> &boxes, std::vector<float> &segments,
-                      float *proto, std::vector<float> &objProbs, std::vector<int> &classId,
-                      float threshold, RknnCtx *nn_ctx)
+/*
+ * The proto grid is a quarter of the model input, so the bilinear resize of
+ * a mask is an exact 4x upsample: output 4k + p reads the proto cells
+ * k - 1, k for p < 2 and k, k + 1 otherwise, with weights of 1/8 below.
+ */
+static const uint8_t up4_w0[4] = {3, 1, 7, 5};
+static const uint8_t up4_w1[4] = {5, 7, 1, 3};
+
+#define UP4_ROW_PAD     16  /* the simd loop reads and writes one vector past the box */
+
+/* first of the two proto cells and their weights for output coordinate o */
+static inline void up4_taps(int o, int size, int *c0, int *c1, int *phase)
 {
-    int validCount = 0;
-    int grid_len = grid_h * grid_w;
+    int p = o & 3;
+    int c = (o >> 2) - 1 + (p >> 1);
 
-    post_dbg_func("enter\n");
+    *phase = p;
+    *c0 = MPP_CLIP3(0, size - 1, c);
+    *c1 = MPP_CLIP3(0, size - 1, c + 1);
+}
 
-    if (input_id % 2 == 1)
-        return validCount;
+/* proto cells c_start..c_end blended for output row y, col[c + 1] is cell c, in 1/8 */
+static inline void up4_blend_row(const uint8_t *proto_mask, int y, int c_start, int c_end, uint8_t *col)
+{
+    int y0, y1, py;
 
-    if (input_id == 6) { /* prototype masks */
-        int8_t *input_proto = (int8_t *)all_input[input_id].buf;
-        int32_t zp_proto = nn_ctx->output_attrs[input_id].zp;
-        float scale_proto = nn_ctx->output_attrs[input_id].scale;
-        int proto_num = PROTO_CHANNEL * PROTO_HEIGHT * PROTO_WEIGHT;
-        TIMER timer;
+    up4_taps(y, PROTO_HEIGHT, &y0, &y1, &py);
+    const uint8_t *s0 = proto_mask + y0 * PROTO_WEIGHT;
+    const uint8_t *s1 = proto_mask + y1 * PROTO_WEIGHT;
+    uint8_t wy0 = up4_w0[py];
+    uint8_t wy1 = up4_w1[py];
 
-        timer.tik();
-        for (int i = 0; i < proto_num; i++)
-            proto[i] = deqnt_affine_to_f32(input_proto[i], zp_proto, scale_proto);
+    for (int c = c_start; c <= c_end; c++) {
+        int cc = MPP_CLIP3(0, PROTO_WEIGHT - 1, c);
+
+        col[c + 1] = wy0 * s0[cc] + wy1 * s1[cc];
+    }
+}
+
+#if !defined(ENABLE_MASK_BITS) && !(defined(USE_FP_RESIZE) && defined(USE_FP_MASK_MAP))
+/*
+ * Upsample the 0/1 proto mask of one box 4x inside the box and write label to
+ * the pixels of all_mask_in_one it covers first. A pixel is foreground when at
+ * least 1/8 of its bilinear weight is, the rounding cv::resize gave the 0/4
+ * masks this replaces. Used by the label map of RV1126B, RK3588 keeps bits.
+ */
+static void upsample_crop_mask_uint8(const uint8_t *proto_mask, uint8_t *all_mask_in_one, const float *box,
+                                     uint8_t label, int height, int width)
+{
+    image_rect_t r = box_pixel_rect(box, width, height);
+    uint8_t col[PROTO_WEIGHT + 2];  /* vertically blended cells, col[c + 1] is cell c */
+    int c_start, c_end;
+
+    if (r.left >= r.right || r.top >= r.bottom)
+        return;
+
+    /* cells the box columns read */
+    c_start = (r.left >> 2) - 1;
+    c_end = ((r.right - 1) >> 2) + 1;
+
+    for (int y = r.top; y < r.bottom; y++) {
+        uint8_t *dst = all_mask_in_one + y * width;
+
+        up4_blend_row(proto_mask, y, c_start, c_end, col);
+
+        for (int x = r.left; x < r.right; x++) {
+            int p = x & 3;
+            int c = (x >> 2) - 1 + (p >> 1);
+
+            if (dst[x] == 0 && up4_w0[p] * col[c + 1] + up4_w1[p] * col[c + 2] >= 8)
+                dst[x] = label;
+        }
+    }
+}
+#endif
+
+#ifdef ENABLE_MASK_BITS
+/* bits lo..hi - 1 of a word */
+static inline uint64_t mask_bits_range(int lo, int hi)
+{
+    uint64_t m = hi >= 64 ? ~0ULL : (1ULL << hi) - 1;
+
+    return m & ~((1ULL << lo) - 1);
+}
+
+/*
+ * Same upsample as upsample_crop_mask_uint8(), OR-merged into the bitset, 16
+ * cells of a row give one 64 pixel word.
+ */
+static void upsample_crop_mask_bits(const uint8_t *proto_mask, uint64_t *mask_bits, int stride,
+                                    const float *box, int height, int width)
+{
+    image_rect_t r = box_pixel_rect(box, width, height);
+    uint8_t col[PROTO_WEIGHT + 2 + UP4_ROW_PAD];
+    int w_start, w_end, c_start, c_end;
+
+    if (r.left >= r.right || r.top >= r.bottom)
+        return;
+
+    w_start = r.left >> 6;
+    w_end = (r.right - 1) >> 6;
+    c_start = w_start * 16 - 1;
+    c_end = MPP_MIN(w_end * 16 + 16, PROTO_WEIGHT + UP4_ROW_PAD - 1);
+
+    for (int y = r.top; y < r.bottom; y++) {
+        uint64_t *dst = mask_bits + y * stride;
+
+        up4_blend_row(proto_mask, y, c_start, c_end, col);
+
+        for (int w = w_start; w <= w_end; w++) {
+            uint64_t bits = 0;
+            int k = w * 16;
 
 #ifdef ENABLE_NEON
-        /* convert fp32 to fp16 */
-        convert_neon(proto, nn_ctx->vector_b, proto_num);
+            uint8x16_t l = vld1q_u8(col + k);
+            uint8x16_t m = vld1q_u8(col + k + 1);
+            uint8x16_t n = vld1q_u8(col + k + 2);
+            uint8x16_t v_thr = vdupq_n_u8(8);
+            uint8x16_t p0 = vmlaq_u8(vmulq_u8(l, vdupq_n_u8(3)), m, vdupq_n_u8(5));
+            uint8x16_t p1 = vmlaq_u8(l, m, vdupq_n_u8(7));
+            uint8x16_t p2 = vmlaq_u8(n, m, vdupq_n_u8(7));
+            uint8x16_t p3 = vmlaq_u8(vmulq_u8(m, vdupq_n_u8(5)), n, vdupq_n_u8(3));
+
+            /* one nibble per cell, two cells per byte is pixel 8i + j at bit 8i + j */
+            uint8x16_t nib = vorrq_u8(vorrq_u8(vandq_u8(vcgeq_u8(p0, v_thr), vdupq_n_u8(1)),
+                                               vandq_u8(vcgeq_u8(p1, v_thr), vdupq_n_u8(2))),
+                                      vorrq_u8(vandq_u8(vcgeq_u8(p2, v_thr), vdupq_n_u8(4)),
+                                               vandq_u8(vcgeq_u8(p3, v_thr), vdupq_n_u8(8))));
+            uint16x8_t pair = vreinterpretq_u16_u8(nib);
+
+            bits = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(vorrq_u16(pair, vshrq_n_u16(pair, 4)))), 0);
+#else
+            for (int i = 0; i < 64; i++) {
+                int p = i & 3;
+                int c = k + (i >> 2) - 1 + (p >> 1);
+
+                if (up4_w0[p] * col[c + 1] + up4_w1[p] * col[c + 2] >= 8)
+                    bits |= 1ULL << i;
+            }
+#endif
+            dst[w] |= bits & mask_bits_range(MPP_MAX(r.left - w * 64, 0), MPP_MIN(r.right - w * 64, 64));
+        }
+    }
+}
+#endif
+
+#if defined(USE_FP_RESIZE) && defined(USE_FP_MASK_MAP)
+/*
+ * float proto mask of one box, foreground where the upsampled value is above 0,
+ * only built when USE_FP_MASK_MAP is switched on for the npu matmul in postprocess.h
+ */
+static void upsample_crop_mask_fp(const float *proto_mask, uint8_t *all_mask_in_one, const float *box,
+                                  uint8_t label, int height, int width)
+{
+    image_rect_t r = box_pixel_rect(box, width, height);
+
+    for (int y = r.top; y < r.bottom; y++) {
+        int y0, y1, py;
+
+        up4_taps(y, PROTO_HEIGHT, &y0, &y1, &py);
+        for (int x = r.left; x < r.right; x++) {
+            int x0, x1, px;
+            float v;
+
+            up4_taps(x, PROTO_WEIGHT, &x0, &x1, &px);
+            v = up4_w0[py] * (up4_w0[px] * proto_mask[y0 * PROTO_WEIGHT + x0] +
+                              up4_w1[px] * proto_mask[y0 * PROTO_WEIGHT + x1]) +
+                up4_w1[py] * (up4_w0[px] * proto_mask[y1 * PROTO_WEIGHT + x0] +
+                              up4_w1[px] * proto_mask[y1 * PROTO_WEIGHT + x1]);
+            if (all_mask_in_one[y * width + x] == 0 && v > 0)
+                all_mask_in_one[y * width + x] = label;
+        }
+    }
+}
+#endif
+
+/* label of a yolo class in all_mask_in_one, 0 is background and every wanted class is above it */
+static uint8_t mask_label(int cls_id, int scene_mode)
+{
+    // convert yolo class to rk class
+    if (scene_mode == 0) {
+        /* 0: person 1: book */
+        if (cls_id == LABEL_PERSON || cls_id == LABEL_BOOK)
+            return (cls_id == LABEL_BOOK) + 1;
+        return RK_CLASS_OTHER + 1;
+    }
+
+    return to_rk_class(cls_id) + 1;
+}
+
+/*
+ * boxes kept by nms in structure of arrays, every box is moved by
+ * class_id * offset so boxes of different classes never overlap and
+ * one iou test covers all classes
+ */
+typedef struct {
+    float *x1;
+    float *y1;
+    float *x2;
+    float *y2;
+    float *area;
+    float offset; /* beyond any decoded coordinate span */
+    int num;
+} NmsKeep;
+
+static void nms_keep_push(NmsKeep *keep, const float *box, int cls_id)
+{
+    float off = cls_id * keep->offset;
+    int k = keep->num++;
+
+    keep->x1[k] = box[0] + off;
+    keep->y1[k] = box[1] + off;
+    keep->x2[k] = box[0] + box[2] + off;
+    keep->y2[k] = box[1] + box[3] + off;
+    keep->area[k] = (box[2] + 1.0f) * (box[3] + 1.0f);
+}
+
+/*
+ * Batched greedy nms test of a box against all kept boxes, iou > threshold
+ * is checked as inter > threshold * union, both sides are positive.
+ */
+static int nms_suppressed(const NmsKeep *keep, const float *box, int cls_id, float threshold)
+{
+    float off = cls_id * keep->offset;
+    float x1 = box[0] + off;
+    float y1 = box[1] + off;
+    float x2 = box[0] + box[2] + off;
+    float y2 = box[1] + box[3] + off;
+    float area = (box[2] + 1.0f) * (box[3] + 1.0f);
+    int k = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    float32x4_t vx1 = vdupq_n_f32(x1);
+    float32x4_t vy1 = vdupq_n_f32(y1);
+    float32x4_t vx2 = vdupq_n_f32(x2);
+    float32x4_t vy2 = vdupq_n_f32(y2);
+    float32x4_t varea = vdupq_n_f32(area);
+    float32x4_t vthr = vdupq_n_f32(threshold);
+    float32x4_t vone = vdupq_n_f32(1.0f);
+    float32x4_t vzero = vdupq_n_f32(0.0f);
+
+    for (; k + 4 <= keep->num; k += 4) {
+        float32x4_t w = vsubq_f32(vminq_f32(vx2, vld1q_f32(keep->x2 + k)), vmaxq_f32(vx1, vld1q_f32(keep->x1 + k)));
+        float32x4_t h = vsubq_f32(vminq_f32(vy2, vld1q_f32(keep->y2 + k)), vmaxq_f32(vy1, vld1q_f32(keep->y1 + k)));
+        float32x4_t inter = vmulq_f32(vmaxq_f32(vzero, vaddq_f32(w, vone)), vmaxq_f32(vzero, vaddq_f32(h, vone)));
+        float32x4_t uni = vsubq_f32(vaddq_f32(varea, vld1q_f32(keep->area + k)), inter);
+        uint32x4_t hit = vcgtq_f32(inter, vmulq_f32(vthr, uni));
+        uint32x2_t any = vorr_u32(vget_low_u32(hit), vget_high_u32(hit));
+
+        if (vget_lane_u32(any, 0) | vget_lane_u32(any, 1))
+            return 1;
+    }
+#endif
+    for (; k < keep->num; k++) {
+        float w = fmaxf(0.f, fminf(x2, keep->x2[k]) - fmaxf(x1, keep->x1[k]) + 1.0f);
+        float h = fmaxf(0.f, fminf(y2, keep->y2[k]) - fmaxf(y1, keep->y1[k]) + 1.0f);
+        float inter = w * h;
+
+        if (inter > threshold * (area + keep->area[k] - inter))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* one head's slice of the candidate arena */
+typedef struct {
+    float *boxes; /* x y w h */
+    float *segments; /* PROTO_CHANNEL mask coefficients */
+    int8_t *segments_q; /* quantised coefficients, int8 model only */
+    int32_t *seg_zp; /* zero point of segments_q */
+    float *probs;
+    int *class_id;
+} CandSpan;
+
+/*
+ * structure of arrays candidate storage, sized at init for every anchor of
+ * every grid cell, the frame path never grows or allocates anything
+ */
+typedef struct {
+    int cap;
+    int head_base[DECODE_HEAD_NUM]; /* first slot of each head */
+    int head_count[DECODE_HEAD_NUM];
+    float *boxes;
+    float *segments;
+    int8_t *segments_q;
+    int32_t *seg_zp;
+    float *probs;
+    int *class_id;
+    int *heap; /* candidate index max heap on probs */
+    NmsKeep keep; /* boxes kept by nms, max_obj_num entries */
+    float *keep_buf;
+    float *seg_by_nms; /* coefficients of the kept boxes, max_obj_num rows */
+    int8_t *seg_q_by_nms;
+    int32_t *seg_zp_by_nms;
+} CandArena;
+
+/*
+ * Collect the positions of conf[] >= thres into idx[], return the count.
+ * Less than 1% cells pass, so reject 16 cells per compare and only walk
+ * the blocks with a hit.
+ */
+static int scan_conf_i8(const int8_t *conf, int len, int8_t thres, int *idx)
+{
+    int num = 0;
+    int i = 0;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    int8x16_t v_thres = vdupq_n_s8(thres);
+
+    for (; i + 32 <= len; i += 32) {
+        uint8x16_t m0 = vcgeq_s8(vld1q_s8(conf + i), v_thres);
+        uint8x16_t m1 = vcgeq_s8(vld1q_s8(conf + i + 16), v_thres);
+        uint64x2_t m = vreinterpretq_u64_u8(vorrq_u8(m0, m1));
+
+        if (!(vgetq_lane_u64(m, 0) | vgetq_lane_u64(m, 1)))
+            continue;
+
+        for (int k = i; k < i + 32; k++) {
+            idx[num] = k;
+            num += (conf[k] >= thres);
+        }
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        /* fold 8 compares into one branch, the reduction vectorizes on x86 too */
+        int hit = 0;
+
+        for (int k = i; k < i + 8; k++)
+            hit |= (conf[k] >= thres);
+        if (!hit)
+            continue;
+
+        for (int k = i; k < i + 8; k++) {
+            idx[num] = k;
+            num += (conf[k] >= thres);
+        }
+    }
 #endif
-        post_dbg_time("0 - deqnt_affine_to_f32 + convert_neon");
-        return validCount;
+
+    /* branchless compaction for the tail */
+    for (; i < len; i++) {
+        idx[num] = i;
+        num += (conf[i] >= thres);
     }
 
+    return num;
+}
+
+/* int8 to fp32 (and fp16 for the npu matmul) by table, zp and scale of the proto are fixed per model */
+static void setup_proto_lut(RknnCtx *nn_ctx)
+{
+    rknn_tensor_attr *attr = &nn_ctx->output_attrs[DECODE_HEAD_NUM * 2];
+
+    for (int q = -128; q < 128; q++)
+        nn_ctx->proto_lut[(uint8_t)q] = deqnt_affine_to_f32(q, attr->zp, attr->scale);
+#ifdef ENABLE_NEON
+    convert_neon(nn_ctx->proto_lut, nn_ctx->proto_lut_f16, 256);
+#endif
+}
+
+#ifdef ENABLE_NEON
+/* dst[i] = lut[src[i]], 16 lanes per step by 4 x 64 byte table lookups on the low and high bytes */
+static void lut_u8_to_u16(const uint8_t *src, uint16_t *dst, int n, const uint16_t *lut)
+{
+    int i = 0;
+
+#if defined(__aarch64__)
+    uint8x16x4_t lo[4], hi[4];
+
+    for (int t = 0; t < 4; t++) {
+        for (int k = 0; k < 4; k++) {
+            uint8x16x2_t v = vld2q_u8((const uint8_t *)(lut + t * 64 + k * 16));
+
+            lo[t].val[k] = v.val[0];
+            hi[t].val[k] = v.val[1];
+        }
+    }
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t idx = vld1q_u8(src + i);
+        uint8x16x2_t out;
+
+        out.val[0] = vqtbl4q_u8(lo[0], idx);
+        out.val[1] = vqtbl4q_u8(hi[0], idx);
+        for (int t = 1; t < 4; t++) {
+            /* out of range lanes wrap above 63 and keep the previous result */
+            uint8x16_t sub = vsubq_u8(idx, vdupq_n_u8(t * 64));
+
+            out.val[0] = vqtbx4q_u8(out.val[0], lo[t], sub);
+            out.val[1] = vqtbx4q_u8(out.val[1], hi[t], sub);
+        }
+        vst2q_u8((uint8_t *)(dst + i), out);
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = lut[src[i]];
+}
+#endif
+
+/*
+ * Prototype masks of pixels [start, end), only needed once a box survives nms.
+ * The npu matmul reads the fp16 copy, the cpu one the int8 proto transposed
+ * to 32 channels per pixel with the channel sum of each pixel.
+ */
+static void process_proto(rknn_output *all_input, int input_id, RknnCtx *nn_ctx, int start, int end)
+{
+    int proto_len = PROTO_HEIGHT * PROTO_WEIGHT;
+    int num = end - start;
+
+    if (nn_ctx->is_quant) {
+        const uint8_t *input_proto = (const uint8_t *)all_input[input_id].buf;
+
+#ifdef ENABLE_NEON
+        for (int c = 0; c < PROTO_CHANNEL; c++)
+            lut_u8_to_u16(input_proto + c * proto_len + start, nn_ctx->vector_b + c * proto_len + start,
+                          num, nn_ctx->proto_lut_f16);
+#else
+        const int8_t *src = (const int8_t *)input_proto;
+
+        for (int j = start; j < end; j++) {
+            int8_t *dst = nn_ctx->proto_q + j * PROTO_CHANNEL;
+            int32_t sum = 0;
+
+            for (int c = 0; c < PROTO_CHANNEL; c++) {
+                dst[c] = src[c * proto_len + j];
+                sum += dst[c];
+            }
+            nn_ctx->proto_q_sum[j] = sum;
+        }
+#endif
+    } else {
+        for (int c = 0; c < PROTO_CHANNEL; c++) {
+            float *input_proto = (float *)all_input[input_id].buf + c * proto_len + start;
+
+            memcpy(nn_ctx->proto + c * proto_len + start, input_proto, num * sizeof(float));
+#ifdef ENABLE_NEON
+            convert_neon(input_proto, nn_ctx->vector_b + c * proto_len + start, num);
+#endif
+        }
+    }
+}
+
+static int process_i8(rknn_output *all_input, int input_id, int *anchor,
+                      int grid_h, int grid_w, int height, int width, int stride,
+                      CandSpan *span, float threshold, int *cand_idx, RknnCtx *nn_ctx)
+{
+    int validCount = 0;
+    int grid_len = grid_h * grid_w;
+
+    post_dbg_func("enter\n");
+
     int8_t *input = (int8_t *)all_input[input_id].buf;
     int8_t *input_seg = (int8_t *)all_input[input_id + 1].buf;
     int32_t zp = nn_ctx->output_attrs[input_id].zp;
@@ -745,67 +1103,95 @@ static int process_i8(rknn_output *all_input, int input_id, int *anchor,
     post_dbg_detail("thres_i8 %d\n", thres_i8);
 
     for (int a = 0; a < 3; a++) {
-        for (int i = 0; i < grid_h; i++) {
-            for (int j = 0; j < grid_w; j++) {
-                int8_t box_confidence = input[(PROP_BOX_SIZE * a + 4) * grid_len + i * grid_w + j];
-
-                if (box_confidence >= thres_i8) {
-                    int offset = (PROP_BOX_SIZE * a) * grid_len + i * grid_w + j;
-                    int offset_seg = (PROTO_CHANNEL * a) * grid_len + i * grid_w + j;
-                    int8_t *in_ptr = input + offset;
-                    int8_t *in_ptr_seg = input_seg + offset_seg;
-
-                    float box_x = (deqnt_affine_to_f32(*in_ptr, zp, scale)) * 2.0 - 0.5;
-                    float box_y = (deqnt_affine_to_f32(in_ptr[grid_len], zp, scale)) * 2.0 - 0.5;
-                    float box_w = (deqnt_affine_to_f32(in_ptr[2 * grid_len], zp, scale)) * 2.0;
-                    float box_h = (deqnt_affine_to_f32(in_ptr[3 * grid_len], zp, scale)) * 2.0;
-                    box_x = (box_x + j) * (float)stride;
-                    box_y = (box_y + i) * (float)stride;
-                    box_w = box_w * box_w * (float)anchor[a * 2];
-                    box_h = box_h * box_h * (float)anchor[a * 2 + 1];
-                    box_x -= (box_w / 2.0);
-                    box_y -= (box_h / 2.0);
-
-                    post_dbg_detail("a %d i %d j %d box_confidence %d [%f %f %f %f]\n",
-                                    a, i, j, box_confidence, box_x, box_y, box_w, box_h);
-
-                    int8_t maxClassProbs = in_ptr[5 * grid_len];
-                    int maxClassId = 0;
-                    for (int k = 1; k < OBJ_CLASS_NUM; ++k)
+        const int8_t *conf = input + (PROP_BOX_SIZE * a + 4) * grid_len;
+        int cand_num = scan_conf_i8(conf, grid_len, thres_i8, cand_idx);
+
+        /* full decode only on the few cells passing the confidence threshold */
+        for (int c = 0; c < cand_num; c++) {
+            int pos = cand_idx[c];
+            int i = pos / grid_w;
+            int j = pos - i * grid_w;
+            int8_t box_confidence = conf[pos];
+
+            int offset = (PROP_BOX_SIZE * a) * grid_len + i * grid_w + j;
+            int offset_seg = (PROTO_CHANNEL * a) * grid_len + i * grid_w + j;
+            int8_t *in_ptr = input + offset;
+            int8_t *in_ptr_seg = input_seg + offset_seg;
+
+            float box_x = (deqnt_affine_to_f32(*in_ptr, zp, scale)) * 2.0 - 0.5;
+            float box_y = (deqnt_affine_to_f32(in_ptr[grid_len], zp, scale)) * 2.0 - 0.5;
+            float box_w = (deqnt_affine_to_f32(in_ptr[2 * grid_len], zp, scale)) * 2.0;
+            float box_h = (deqnt_affine_to_f32(in_ptr[3 * grid_len], zp, scale)) * 2.0;
+            box_x = (box_x + j) * (float)stride;
+            box_y = (box_y + i) * (float)stride;
+            box_w = box_w * box_w * (float)anchor[a * 2];
+            box_h = box_h * box_h * (float)anchor[a * 2 + 1];
+            box_x -= (box_w / 2.0);
+            box_y -= (box_h / 2.0);
+
+            post_dbg_detail("a %d i %d j %d box_confidence %d [%f %f %f %f]\n",
+                            a, i, j, box_confidence, box_x, box_y, box_w, box_h);
+
+            int8_t maxClassProbs;
+            int maxClassId;
+            if (nn_ctx->class_only) {
+                maxClassId = nn_ctx->class_ids[0];
+                maxClassProbs = in_ptr[(5 + maxClassId) * grid_len];
+                for (int n = 1; n < nn_ctx->class_num; ++n) {
+                    int k = nn_ctx->class_ids[n];
+                    int8_t prob = in_ptr[(5 + k) * grid_len];
+                    if (prob > maxClassProbs) {
+                        maxClassId = k;
+                        maxClassProbs = prob;
+                    }
+                }
+            } else {
+                maxClassProbs = in_ptr[5 * grid_len];
+                maxClassId = 0;
+                for (int k = 1; k < OBJ_CLASS_NUM; ++k)
+                {
+                    int8_t prob = in_ptr[(5 + k) * grid_len];
+                    if (prob > maxClassProbs)
                     {
-                        int8_t prob = in_ptr[(5 + k) * grid_len];
-                        if (prob > maxClassProbs)
-                        {
-                            maxClassId = k;
-                            maxClassProbs = prob;
-                        }
+                        maxClassId = k;
+                        maxClassProbs = prob;
                     }
-                    post_dbg_detail("a %d i %d j %d maxClassProbs %d maxClassId %d\n",
-                                    a, i, j, maxClassProbs, maxClassId);
+                }
+            }
+            post_dbg_detail("a %d i %d j %d maxClassProbs %d maxClassId %d\n",
+                            a, i, j, maxClassProbs, maxClassId);
 
-                    float box_conf_f32 = deqnt_affine_to_f32(box_confidence, zp, scale);
-                    float class_prob_f32 = deqnt_affine_to_f32(maxClassProbs, zp, scale);
-                    float limit_score = box_conf_f32 * class_prob_f32;
-                    // if (maxClassProbs > thres_i8)
-                    if (limit_score > threshold)
-                    {
-                        post_dbg_detail("a %d i %d j %d box_conf %f class_prob %f limit_score %f threshold %f\n",
-                                        a, i, j, box_conf_f32, class_prob_f32, limit_score, threshold);
-                        for (int k = 0; k < PROTO_CHANNEL; k++)
-                        {
-                            float seg_element_fp = deqnt_affine_to_f32(in_ptr_seg[(k)*grid_len], zp_seg, scale_seg);
-                            segments.push_back(seg_element_fp);
-                        }
+            /* unwanted classes never reach the output, drop before sort and nms */
+            if (!nn_ctx->class_wanted[maxClassId])
+                continue;
 
-                        objProbs.push_back((deqnt_affine_to_f32(maxClassProbs, zp, scale)) * (deqnt_affine_to_f32(box_confidence, zp, scale)));
-                        classId.push_back(maxClassId);
-                        validCount++;
-                        boxes.push_back(box_x);
-                        boxes.push_back(box_y);
-                        boxes.push_back(box_w);
-                        boxes.push_back(box_h);
-                    }
+            float box_conf_f32 = deqnt_affine_to_f32(box_confidence, zp, scale);
+            float class_prob_f32 = deqnt_affine_to_f32(maxClassProbs, zp, scale);
+            float limit_score = box_conf_f32 * class_prob_f32;
+            // if (maxClassProbs > thres_i8)
+            if (limit_score > threshold)
+            {
+                post_dbg_detail("a %d i %d j %d box_conf %f class_prob %f limit_score %f threshold %f\n",
+                                a, i, j, box_conf_f32, class_prob_f32, limit_score, threshold);
+                float *segments = span->segments + validCount * PROTO_CHANNEL;
+                float *boxes = span->boxes + validCount * 4;
+
+                int8_t *segments_q = span->segments_q + validCount * PROTO_CHANNEL;
+
+                for (int k = 0; k < PROTO_CHANNEL; k++)
+                {
+                    segments_q[k] = in_ptr_seg[(k)*grid_len];
+                    segments[k] = deqnt_affine_to_f32(segments_q[k], zp_seg, scale_seg);
                 }
+                span->seg_zp[validCount] = zp_seg;
+
+                span->probs[validCount] = (deqnt_affine_to_f32(maxClassProbs, zp, scale)) * (deqnt_affine_to_f32(box_confidence, zp, scale));
+                span->class_id[validCount] = maxClassId;
+                validCount++;
+                boxes[0] = box_x;
+                boxes[1] = box_y;
+                boxes[2] = box_w;
+                boxes[3] = box_h;
             }
         }
     }
@@ -816,28 +1202,13 @@ static int process_i8(rknn_output *all_input, int input_id, int *anchor,
 }
 
 static int process_fp32(rknn_output *all_input, int input_id, int *anchor, int grid_h, int grid_w, int height, int width, int stride,
-                        std::vector<float> &boxes, std::vector<float> &segments, float *proto, std::vector<float> &objProbs, std::vector<int> &classId, float threshold)
+                        CandSpan *span, float threshold, RknnCtx *nn_ctx)
 {
     int validCount = 0;
     int grid_len = grid_h * grid_w;
 
     post_dbg_func("enter\n");
 
-    if (input_id % 2 == 1)
-    {
-        return validCount;
-    }
-
-    if (input_id == 6)
-    {
-        float *input_proto = (float *)all_input[input_id].buf;
-        for (int i = 0; i < PROTO_CHANNEL * PROTO_HEIGHT * PROTO_WEIGHT; i++)
-        {
-            proto[i] = input_proto[i];
-        }
-        return validCount;
-    }
-
     float *input = (float *)all_input[input_id].buf;
     float *input_seg = (float *)all_input[input_id + 1].buf;
 
@@ -866,34 +1237,58 @@ static int process_fp32(rknn_output *all_input, int input_id, int *anchor, int g
                     box_x -= (box_w / 2.0);
                     box_y -= (box_h / 2.0);
 
-                    float maxClassProbs = in_ptr[5 * grid_len];
-                    int maxClassId = 0;
-                    for (int k = 1; k < OBJ_CLASS_NUM; ++k)
+                    float maxClassProbs;
+                    int maxClassId;
+                    if (nn_ctx->class_only)
+                    {
+                        maxClassId = nn_ctx->class_ids[0];
+                        maxClassProbs = in_ptr[(5 + maxClassId) * grid_len];
+                        for (int c = 1; c < nn_ctx->class_num; ++c)
+                        {
+                            int k = nn_ctx->class_ids[c];
+                            float prob = in_ptr[(5 + k) * grid_len];
+                            if (prob > maxClassProbs)
+                            {
+                                maxClassId = k;
+                                maxClassProbs = prob;
+                            }
+                        }
+                    }
+                    else
                     {
-                        float prob = in_ptr[(5 + k) * grid_len];
-                        if (prob > maxClassProbs)
+                        maxClassProbs = in_ptr[5 * grid_len];
+                        maxClassId = 0;
+                        for (int k = 1; k < OBJ_CLASS_NUM; ++k)
                         {
-                            maxClassId = k;
-                            maxClassProbs = prob;
+                            float prob = in_ptr[(5 + k) * grid_len];
+                            if (prob > maxClassProbs)
+                            {
+                                maxClassId = k;
+                                maxClassProbs = prob;
+                            }
                         }
                     }
+                    if (!nn_ctx->class_wanted[maxClassId])
+                        continue;
                     float limit_score = maxClassProbs * box_confidence;
                     // if (maxClassProbs > threshold)
                     if (limit_score > threshold)
                     {
+                        float *segments = span->segments + validCount * PROTO_CHANNEL;
+                        float *boxes = span->boxes + validCount * 4;
+
                         for (int k = 0; k < PROTO_CHANNEL; k++)
                         {
-                            float seg_element_f32 = in_ptr_seg[(k)*grid_len];
-                            segments.push_back(seg_element_f32);
+                            segments[k] = in_ptr_seg[(k)*grid_len];
                         }
 
-                        objProbs.push_back(maxClassProbs * box_confidence);
-                        classId.push_back(maxClassId);
+                        span->probs[validCount] = maxClassProbs * box_confidence;
+                        span->class_id[validCount] = maxClassId;
                         validCount++;
-                        boxes.push_back(box_x);
-                        boxes.push_back(box_y);
-                        boxes.push_back(box_w);
-                        boxes.push_back(box_h);
+                        boxes[0] = box_x;
+                        boxes[1] = box_y;
+                        boxes[2] = box_w;
+                        boxes[3] = box_h;
                     }
                 }
             }
@@ -905,21 +1300,45 @@ static int process_fp32(rknn_output *all_input, int input_id, int *anchor, int g
     return validCount;
 }
 
-static int check_unwanted_class_id(int cls_id, int scene_mode)
+static int check_unwanted_class_id(int cls_id, RknnCtx *nn_ctx)
+{
+    return cls_id < 0 || cls_id >= OBJ_CLASS_NUM || !nn_ctx->class_wanted[cls_id];
+}
+
+static void setup_class_set(RknnCtx *nn_ctx)
 {
+    /* default class set of each yolo scene mode */
     static LabelName label_names[2][5] = {
         { LABEL_PERSON, LABEL_BOOK, LABEL_BUTT, LABEL_BUTT, LABEL_BUTT },
         { LABEL_PERSON, LABEL_BICYCLE, LABEL_CAR, LABEL_MOTORCYCLE, LABEL_BUS }
     };
-    int unwanted_flag = 1;
+    int num = 0;
 
-    for (int k = 0; k < 5; k++)
-        unwanted_flag &= (cls_id != label_names[scene_mode][k]);
+    memset(nn_ctx->class_wanted, 0, sizeof(nn_ctx->class_wanted));
+    for (int k = 0; k < nn_ctx->class_num && k < OBJ_CLASS_NUM; k++) {
+        int id = nn_ctx->class_ids[k];
 
-    return unwanted_flag;
+        if (id < 0 || id >= OBJ_CLASS_NUM || nn_ctx->class_wanted[id])
+            continue;
+        nn_ctx->class_wanted[id] = 1;
+        nn_ctx->class_ids[num++] = id;
+    }
+
+    if (!num) {
+        int mode = (nn_ctx->scene_mode == 0) ? 0 : 1;
+
+        for (int k = 0; k < 5; k++) {
+            if (label_names[mode][k] == LABEL_BUTT)
+                continue;
+            nn_ctx->class_wanted[label_names[mode][k]] = 1;
+            nn_ctx->class_ids[num++] = label_names[mode][k];
+        }
+    }
+    nn_ctx->class_num = num;
 }
 
-static int calc_matrix_multiply(RknnCtx *nn_ctx, std::vector<float> &filterSegments_by_nms, int boxes_num)
+#ifdef USE_FP_RESIZE
+static int calc_matrix_multiply(RknnCtx *nn_ctx, const float *filterSegments_by_nms, int boxes_num)
 {
     int ret = 0;
     TIMER timer;
@@ -928,9 +1347,6 @@ static int calc_matrix_multiply(RknnCtx *nn_ctx, std::vector<float> &filterSegme
     int COLS_B = PROTO_HEIGHT * PROTO_WEIGHT;
 
     timer.tik();
-#ifdef USE_FP_RESIZE
-    memset(nn_ctx->matmul_out, 0, boxes_num * PROTO_HEIGHT * PROTO_WEIGHT * sizeof(float));
-
     if (boxes_num > 0) {
 #ifdef ENABLE_MATMUL_OPT
         matmul_by_npu_fp_optimized(filterSegments_by_nms, nn_ctx->matmul_out, ROWS_A, COLS_A, COLS_B, nn_ctx);
@@ -940,13 +1356,146 @@ static int calc_matrix_multiply(RknnCtx *nn_ctx, std::vector<float> &filterSegme
     } else
         mpp_log("boxes_num(%d) <= 0, no need to do matmul\n", boxes_num);
     post_dbg_time("3 - matmul_by_cpu_fp/optimized");
+
+    return ret;
+}
+#endif
+
+/*
+ * Mask of box b on the proto grid, 0/1 or float, only its footprint is valid.
+ * Masks go through trans_detect_result() one box at a time, so matmul_out is
+ * a single plane unless matmul_by_npu_fp() returns every box at once.
+ */
+#if defined(USE_FP_RESIZE) && defined(USE_FP_MASK_MAP)
+static float *box_proto_mask(RknnCtx *nn_ctx, int b)
+{
+#ifdef ENABLE_MATMUL_OPT
+    return (float *)nn_ctx->tensor_c->virt_addr + b * PROTO_HEIGHT * PROTO_WEIGHT;
 #else
-    memset(nn_ctx->matmul_out, 0, boxes_num * PROTO_HEIGHT * PROTO_WEIGHT * sizeof(uint8_t));
-    matmul_by_cpu_uint8(filterSegments_by_nms, nn_ctx->proto, nn_ctx->matmul_out, ROWS_A, COLS_A, COLS_B); //TODO:fix
-    post_dbg_time("3 - matmul_by_cpu_uint8");
+    return nn_ctx->matmul_out + b * PROTO_HEIGHT * PROTO_WEIGHT;
 #endif
+}
+#else
+static uint8_t *box_proto_mask(RknnCtx *nn_ctx, int b)
+{
+    uint8_t *out = nn_ctx->matmul_out;
+#ifdef USE_FP_RESIZE
+#ifdef ENABLE_MASK_MERGE
+    /* one merged plane, boxes only upsample their own footprint of it */
+    (void)b;
+#else
+    const float *c = (const float *)nn_ctx->tensor_c->virt_addr + b * PROTO_HEIGHT * PROTO_WEIGHT;
+    const image_rect_t *r = &nn_ctx->proto_rect[b];
 
-    return ret;
+    for (int y = r->top; y < r->bottom; y++) {
+        for (int x = y * PROTO_WEIGHT + r->left; x < y * PROTO_WEIGHT + r->right; x++)
+            out[x] = c[x] > 0;
+    }
+#endif
+#else
+    CandArena *arena = (CandArena *)nn_ctx->cand_arena;
+
+    if (nn_ctx->is_quant)
+        matmul_sign_i8(arena->seg_q_by_nms + b * PROTO_CHANNEL, arena->seg_zp_by_nms + b,
+                       nn_ctx->proto_q, nn_ctx->proto_q_sum, nn_ctx->output_attrs[DECODE_HEAD_NUM * 2].zp,
+                       out, 1, PROTO_HEIGHT * PROTO_WEIGHT, &nn_ctx->proto_rect[b]);
+    else
+        matmul_by_cpu_uint8(arena->seg_by_nms + b * PROTO_CHANNEL, nn_ctx->proto, out, 1, PROTO_CHANNEL,
+                            PROTO_HEIGHT * PROTO_WEIGHT, &nn_ctx->proto_rect[b]);
+#endif
+    return out;
+}
+#endif
+
+typedef struct {
+    RknnCtx *nn_ctx;
+    rknn_output *outputs;
+    float conf_threshold;
+} DecodeTaskArg;
+
+static CandSpan cand_arena_span(CandArena *arena, int head)
+{
+    int base = arena->head_base[head];
+    CandSpan span = {
+        arena->boxes + base * 4,
+        arena->segments + base * PROTO_CHANNEL,
+        arena->segments_q + base * PROTO_CHANNEL,
+        arena->seg_zp + base,
+        arena->probs + base,
+        arena->class_id + base,
+    };
+
+    return span;
+}
+
+/* move the head slices together in head order, return the candidate count */
+static int cand_arena_compact(CandArena *arena)
+{
+    int count = 0;
+
+    for (int h = 0; h < DECODE_HEAD_NUM; h++) {
+        int base = arena->head_base[h];
+        int n = arena->head_count[h];
+
+        if (n && base != count) {
+            memmove(arena->boxes + count * 4, arena->boxes + base * 4, n * 4 * sizeof(float));
+            memmove(arena->segments + count * PROTO_CHANNEL, arena->segments + base * PROTO_CHANNEL,
+                    n * PROTO_CHANNEL * sizeof(float));
+            memmove(arena->segments_q + count * PROTO_CHANNEL, arena->segments_q + base * PROTO_CHANNEL,
+                    n * PROTO_CHANNEL);
+            memmove(arena->seg_zp + count, arena->seg_zp + base, n * sizeof(int32_t));
+            memmove(arena->probs + count, arena->probs + base, n * sizeof(float));
+            memmove(arena->class_id + count, arena->class_id + base, n * sizeof(int));
+        }
+        count += n;
+    }
+
+    return count;
+}
+
+/* task k converts the k-th pixel slice of the proto, slices are kept 16 aligned for the simd lookup */
+static void proto_task(void *arg, int idx)
+{
+    DecodeTaskArg *task = (DecodeTaskArg *)arg;
+    int proto_num = PROTO_HEIGHT * PROTO_WEIGHT;
+    int task_num = worker_pool_thread_num(task->nn_ctx->decode_pool);
+    int slice = MPP_ALIGN((proto_num + task_num - 1) / task_num, 16);
+    int start = MPP_MIN(idx * slice, proto_num);
+    int end = MPP_MIN(start + slice, proto_num);
+
+    if (start < end)
+        process_proto(task->outputs, DECODE_HEAD_NUM * 2, task->nn_ctx, start, end);
+}
+
+/* task k decodes head k */
+static void decode_head_task(void *arg, int idx)
+{
+    DecodeTaskArg *task = (DecodeTaskArg *)arg;
+    RknnCtx *nn_ctx = task->nn_ctx;
+    CandArena *arena = (CandArena *)nn_ctx->cand_arena;
+    int head = idx;
+    int input_id = head * 2;
+    int grid_h, grid_w, stride;
+    CandSpan span;
+
+    span = cand_arena_span(arena, head);
+    grid_h = nn_ctx->output_attrs[input_id].dims[2];
+    grid_w = nn_ctx->output_attrs[input_id].dims[3];
+    stride = nn_ctx->model_height / grid_h;
+
+    post_dbg_detail("idx %d grid_h %d grid_w %d stride %d\n", input_id, grid_h, grid_w, stride);
+
+    if (nn_ctx->is_quant) {
+        arena->head_count[head] = process_i8(task->outputs, input_id, (int *)anchor[head], grid_h, grid_w,
+                                             nn_ctx->model_height, nn_ctx->model_width, stride, &span,
+                                             task->conf_threshold,
+                                             nn_ctx->cand_idx + head * nn_ctx->cand_grid_max, nn_ctx);
+    } else {
+        arena->head_count[head] = process_fp32(task->outputs, input_id, (int *)anchor[head], grid_h, grid_w,
+                                               nn_ctx->model_height, nn_ctx->model_width, stride, &span,
+                                               task->conf_threshold, nn_ctx);
+    }
+    post_dbg_detail("idx %d validCount %d\n", input_id, arena->head_count[head]);
 }
 
 int calc_instance_mask(RknnCtx *nn_ctx, rknn_output *outputs,
@@ -954,88 +1503,78 @@ int calc_instance_mask(RknnCtx *nn_ctx, rknn_output *outputs,
                        object_detect_result_list *od_results)
 {
     int ret = 0;
-    std::vector<float> filterBoxes;
-    std::vector<float> objProbs;
-    std::vector<int> classId;
-
-    std::vector<float> filterSegments;
-    std::vector<float> filterSegments_by_nms;
+    CandArena *arena = (CandArena *)nn_ctx->cand_arena;
+    float *filterBoxes = arena->boxes;
+    float *objProbs = arena->probs;
+    int *classId = arena->class_id;
+    float *filterSegments = arena->segments;
+    float *filterSegments_by_nms = arena->seg_by_nms;
+    NmsKeep *keep = &arena->keep;
+    int heap_num = 0;
 
     int model_in_width = nn_ctx->model_width;
     int model_in_height = nn_ctx->model_height;
 
     int validCount = 0;
-    int stride = 0;
-    int grid_h = 0;
-    int grid_w = 0;
+    DecodeTaskArg task_arg = { nn_ctx, outputs, conf_threshold };
     TIMER timer;
 
     post_dbg_func("enter\n");
 
     timer.tik();
-    // process the outputs of rknn
-    for (int i = 0; i < 7; i++) {
-        grid_h = nn_ctx->output_attrs[i].dims[2];
-        grid_w = nn_ctx->output_attrs[i].dims[3];
-        stride = model_in_height / grid_h;
-
-        post_dbg_detail("idx %d grid_h %d grid_w %d stride %d\n", i, grid_h, grid_w, stride);
+    // process the outputs of rknn, the heads are independent, decode them concurrently
+    worker_pool_run(nn_ctx->decode_pool, decode_head_task, &task_arg, DECODE_HEAD_NUM);
 
-        if (nn_ctx->is_quant) {
-            validCount += process_i8(outputs, i, (int *)anchor[i / 2], grid_h, grid_w,
-                                     model_in_height, model_in_width, stride, filterBoxes,
-                                     filterSegments, nn_ctx->proto, objProbs,
-                                     classId, conf_threshold, nn_ctx);
-            post_dbg_detail("idx %d validCount %d\n", i, validCount);
-        } else {
-            validCount += process_fp32(outputs, i, (int *)anchor[i / 2], grid_h, grid_w,
-                                       model_in_height, model_in_width, stride, filterBoxes,
-                                       filterSegments, nn_ctx->proto, objProbs, classId, conf_threshold);
-        }
-    }
+    // merge in head order, the candidate order is the same as a serial decode
+    validCount = cand_arena_compact(arena);
     post_dbg_time("0 - process_i8");
 
     // nms
+    od_results->count = 0;
     if (validCount <= 0) {
         mpp_log("no valid detection results\n");
         return 0;
     }
 
+    /*
+     * at most max_obj_num boxes are emitted, so the candidates are not sorted,
+     * they are popped from a heap in score order only until nms keeps enough
+     */
     timer.tik();
-    std::vector<int> indexArray;
-    for (int i = 0; i < validCount; ++i)
-        indexArray.push_back(i);
+    heap_num = validCount;
+    cand_heap_build(objProbs, arena->heap, heap_num);
 
-    quick_sort_indice_inverse(objProbs, 0, validCount - 1, indexArray);
-    post_dbg_time("1 - quick_sort_indice_inverse");
+    int last_count = 0;
+    int pop_count = 0;
 
-    timer.tik();
-    std::set<int> class_set(std::begin(classId), std::end(classId));
-    for (auto c : class_set) {
-        nms(validCount, filterBoxes, classId, indexArray, c, nms_threshold);
-    }
-    post_dbg_time("2 - nms");
+    keep->num = 0;
 
-    int last_count = 0;
-    od_results->count = 0;
+    while (heap_num > 0 && last_count < nn_ctx->max_obj_num) {
+        int n = cand_heap_pop(objProbs, arena->heap, &heap_num);
 
-    for (int i = 0; i < validCount; ++i) {
-        if (indexArray[i] == -1 || last_count >= OBJ_NUMB_MAX_SIZE)
+        pop_count++;
+        if (nms_suppressed(keep, filterBoxes + n * 4, classId[n], nms_threshold))
             continue;
 
-        int n = indexArray[i];
         float x1 = filterBoxes[n * 4 + 0];
         float y1 = filterBoxes[n * 4 + 1];
         float x2 = x1 + filterBoxes[n * 4 + 2];
         float y2 = y1 + filterBoxes[n * 4 + 3];
         int id = classId[n];
-        float obj_conf = objProbs[i];
+        float obj_conf = objProbs[n];
 
-        if (check_unwanted_class_id(id, nn_ctx->scene_mode))
+        if (check_unwanted_class_id(id, nn_ctx))
             continue;
 
-        for (int k = 0; k < PROTO_CHANNEL; k++)
-            filterSegments_by_nms.push_back(filterSegments[n * PROTO_CHANNEL + k]);
+        nms_keep_push(keep, filterBoxes + n * 4, id);
+
+        memcpy(filterSegments_by_nms + last_count * PROTO_CHANNEL, filterSegments + n * PROTO_CHANNEL,
+               PROTO_CHANNEL * sizeof(float));
+        if (nn_ctx->is_quant) {
+            memcpy(arena->seg_q_by_nms + last_count * PROTO_CHANNEL, arena->segments_q + n * PROTO_CHANNEL,
+                   PROTO_CHANNEL);
+            arena->seg_zp_by_nms[last_count] = arena->seg_zp[n];
+        }
 
         od_results->results[last_count].box.left = x1;
         od_results->results[last_count].box.top = y1;
@@ -1047,6 +1586,8 @@ int calc_instance_mask(RknnCtx *nn_ctx, rknn_output *outputs,
         last_count++;
     }
     od_results->count = last_count;
+    post_dbg_time("1 - top-k nms");
+    post_dbg_detail("nms popped %d of %d candidates, kept %d\n", pop_count, validCount, last_count);
     int boxes_num = od_results->count;
 
     for (int i = 0; i < boxes_num; i++) {
@@ -1056,6 +1597,9 @@ int calc_instance_mask(RknnCtx *nn_ctx, rknn_output *outputs,
         nn_ctx->filterBoxes_by_nms[i * 4 + 2] = od_results->results[i].box.right;  // x2;
         nn_ctx->filterBoxes_by_nms[i * 4 + 3] = od_results->results[i].box.bottom; // y2;
         nn_ctx->cls_id[i] = od_results->results[i].cls_id;
+        nn_ctx->proto_rect[i] = proto_footprint(box_pixel_rect(&nn_ctx->filterBoxes_by_nms[i * 4],
+                                                               model_in_width, model_in_height),
+                                                model_in_width / PROTO_WEIGHT, model_in_height / PROTO_HEIGHT);
 
         // get real box
         od_results->results[i].box.left = box_reverse(od_results->results[i].box.left, model_in_width, letter_box->x_pad, letter_box->scale);
@@ -1068,8 +1612,21 @@ int calc_instance_mask(RknnCtx *nn_ctx, rknn_output *outputs,
                              od_results->results[i].cls_id, od_results->results[i].prop);
     }
 
-    if (nn_ctx->segmap_calc_en)
+    if (nn_ctx->segmap_calc_en) {
+        /* the proto is only read by the matmul, skip it when nothing is left */
+        if (boxes_num > 0) {
+            timer.tik();
+            /* one slice per thread, the caller included */
+            worker_pool_run(nn_ctx->decode_pool, proto_task, &task_arg,
+                            worker_pool_thread_num(nn_ctx->decode_pool));
+            post_dbg_time("2 - proto lut");
+        }
+#ifdef USE_FP_RESIZE
         ret = calc_matrix_multiply(nn_ctx, filterSegments_by_nms, boxes_num);
+#else
+        /* the cpu computes each box right before its upsample, see box_proto_mask() */
+#endif
+    }
 
     post_dbg_func("exit\n");
     return ret;
@@ -1083,64 +1640,56 @@ int trans_detect_result(RknnCtx *nn_ctx, letterbox_t *letter_box, object_detect_
     int model_in_width = nn_ctx->model_width;
     int model_in_height = nn_ctx->model_height;
 
+#ifdef ENABLE_MASK_BITS
+    memset(nn_ctx->mask_bits, 0, model_in_height * nn_ctx->mask_bits_stride * sizeof(uint64_t));
+#else
     memset(nn_ctx->all_mask_in_one, 0, model_in_height * model_in_width * sizeof(uint8_t));
+#endif
 
-#if defined(USE_FP_RESIZE) && defined(USE_FP_MASK_MAP)
-    timer.tik();
-    // resize to (boxes_num, model_in_width, model_in_height)
-    resize_by_opencv_fp(nn_ctx->matmul_out, PROTO_WEIGHT, PROTO_HEIGHT, boxes_num,
-                        nn_ctx->seg_mask, model_in_width, model_in_height);
-    post_dbg_time("4 - resize_by_opencv_fp");
-
+    /* one box at a time, upsampled inside its rectangle straight into all_mask_in_one */
     timer.tik();
-    crop_mask_fp(nn_ctx->seg_mask, nn_ctx->all_mask_in_one,
-                 nn_ctx->filterBoxes_by_nms,
-                 boxes_num, nn_ctx->cls_id,
-                 model_in_height, model_in_width, nn_ctx->scene_mode);
-    post_dbg_time("4 - crop_mask_fp");
+    for (int b = 0; b < boxes_num; b++) {
+#ifdef ENABLE_MASK_BITS
+        upsample_crop_mask_bits(box_proto_mask(nn_ctx, b), nn_ctx->mask_bits, nn_ctx->mask_bits_stride,
+                                &nn_ctx->filterBoxes_by_nms[b * 4], model_in_height, model_in_width);
 #else
-    timer.tik();
 #ifdef ENABLE_MASK_MERGE
-    resize_by_opencv_uint8(nn_ctx->matmul_out, PROTO_WEIGHT, PROTO_HEIGHT, 1,
-        nn_ctx->seg_mask, model_in_width, model_in_height);
+        uint8_t label = 1;
 #else
-    resize_by_opencv_uint8(nn_ctx->matmul_out, PROTO_WEIGHT, PROTO_HEIGHT, boxes_num,
-                           nn_ctx->seg_mask, model_in_width, model_in_height);
+        uint8_t label = mask_label(nn_ctx->cls_id[b], nn_ctx->scene_mode);
 #endif
-    post_dbg_time("4 - resize_by_opencv_uint8");
 
-    timer.tik();
-
-#ifdef ENABLE_MASK_MERGE
-    crop_mask_uint8_merge(nn_ctx->seg_mask, nn_ctx->all_mask_in_one,
-                          nn_ctx->filterBoxes_by_nms,
-                          boxes_num, nn_ctx->cls_id,
-                          model_in_height, model_in_width, nn_ctx->scene_mode);
+#if defined(USE_FP_RESIZE) && defined(USE_FP_MASK_MAP)
+        upsample_crop_mask_fp(box_proto_mask(nn_ctx, b), nn_ctx->all_mask_in_one,
+                              &nn_ctx->filterBoxes_by_nms[b * 4], label, model_in_height, model_in_width);
 #else
-    crop_mask_uint8(nn_ctx->seg_mask, nn_ctx->all_mask_in_one,
-                    nn_ctx->filterBoxes_by_nms,
-                    boxes_num, nn_ctx->cls_id,
-                    model_in_height, model_in_width, nn_ctx->scene_mode);
+        upsample_crop_mask_uint8(box_proto_mask(nn_ctx, b), nn_ctx->all_mask_in_one,
+                                 &nn_ctx->filterBoxes_by_nms[b * 4], label, model_in_height, model_in_width);
 #endif
-    post_dbg_time("4 - crop_mask_uint8");
 #endif
+    }
+    post_dbg_time("4 - upsample_crop_mask");
+
+    /* blocks are classified on all_mask_in_one directly, no input resolution mask */
+    if (!nn_ctx->full_mask_en) {
+        od_results->results_seg[0].seg_mask = NULL;
+        post_dbg_func("exit\n");
+        return ret;
+    }
 
     // get real mask
-    int cropped_height = model_in_height - letter_box->y_pad * 2;
-    int cropped_width = model_in_width - letter_box->x_pad * 2;
     int ori_in_height = nn_ctx->input_image_height;
     int ori_in_width = nn_ctx->input_image_width;
-    int y_pad = letter_box->y_pad;
-    int x_pad = letter_box->x_pad;
     uint8_t *real_seg_mask;
 
-    post_dbg_mask("x_pad %d y_pad %d cropped_height %d cropped_width %d\n",
-                  x_pad, y_pad, cropped_height, cropped_width);
+    post_dbg_mask("x_pad %d y_pad %d input %dx%d\n",
+                  letter_box->x_pad, letter_box->y_pad, ori_in_width, ori_in_height);
 
     if (nn_ctx->pre_alloc_mask) {
         real_seg_mask = nn_ctx->real_seg_mask;
     } else {
         real_seg_mask = (uint8_t *)malloc(ori_in_height * ori_in_width * sizeof(uint8_t));
+        nn_ctx->frame_alloc_num++;
         if (real_seg_mask == NULL) {
             mpp_err_f("malloc real_seg_mask failed\n");
             return -1;
@@ -1148,10 +1697,9 @@ int trans_detect_result(RknnCtx *nn_ctx, letterbox_t *letter_box, object_detect_
     }
     od_results->results_seg[0].seg_mask = real_seg_mask;
 
+    /* proj_x/proj_y are built for this frame by post_process_image() */
     timer.tik();
-    seg_reverse(nn_ctx->all_mask_in_one, nn_ctx->cropped_seg_mask, real_seg_mask,
-                model_in_height, model_in_width, cropped_height, cropped_width,
-                ori_in_height, ori_in_width, y_pad, x_pad);
+    seg_reverse(nn_ctx, real_seg_mask, ori_in_height, ori_in_width);
     post_dbg_time("4 - seg_reverse");
 
     post_dbg_func("exit\n");
@@ -1168,6 +1716,112 @@ int init_post_process(RknnCtx *nn_ctx)
     if (nn_ctx->show_time_lvl >= 2)
         post_debug |= POST_DBG_TIME;
 
+    /*
+     * every object slot costs nms and coefficient rows in the arena, a matmul
+     * shape and a mask plane, keep only what is needed. No nn_max_obj leaves
+     * 0 here, so clamp before anything below is sized from it.
+     */
+    if (nn_ctx->max_obj_num <= 0 || nn_ctx->max_obj_num > OBJ_NUMB_MAX_SIZE)
+        nn_ctx->max_obj_num = OBJ_NUMB_MAX_SIZE;
+
+    {
+        int grid_max = 0;
+
+        for (uint32_t i = 0; i < nn_ctx->io_num.n_output; i++)
+            grid_max = MPP_MAX(grid_max, (int)(nn_ctx->output_attrs[i].dims[2] * nn_ctx->output_attrs[i].dims[3]));
+
+        nn_ctx->cand_grid_max = grid_max;
+        nn_ctx->cand_idx = (int *)calloc(1, DECODE_HEAD_NUM * grid_max * sizeof(int));
+        if (!nn_ctx->cand_idx) {
+            mpp_err_f("malloc nn_ctx->cand_idx failed!\n");
+            return -1;
+        }
+    }
+
+    {
+        CandArena *arena = (CandArena *)calloc(1, sizeof(CandArena));
+
+        if (!arena) {
+            mpp_err_f("malloc candidate arena failed!\n");
+            return -1;
+        }
+        nn_ctx->cand_arena = arena;
+
+        for (int h = 0; h < DECODE_HEAD_NUM; h++) {
+            rknn_tensor_attr *attr = &nn_ctx->output_attrs[h * 2];
+
+            arena->head_base[h] = arena->cap;
+            arena->cap += 3 * attr->dims[2] * attr->dims[3]; /* 3 anchors per cell */
+        }
+
+        arena->boxes = (float *)calloc(arena->cap * 4, sizeof(float));
+        arena->segments = (float *)calloc(arena->cap * PROTO_CHANNEL, sizeof(float));
+        arena->probs = (float *)calloc(arena->cap, sizeof(float));
+        arena->class_id = (int *)calloc(arena->cap, sizeof(int));
+        arena->heap = (int *)calloc(arena->cap, sizeof(int));
+        arena->keep_buf = (float *)calloc(MPP_ALIGN(nn_ctx->max_obj_num, 4) * 5, sizeof(float));
+        arena->seg_by_nms = (float *)calloc(nn_ctx->max_obj_num * PROTO_CHANNEL, sizeof(float));
+        arena->segments_q = (int8_t *)calloc(arena->cap, PROTO_CHANNEL);
+        arena->seg_zp = (int32_t *)calloc(arena->cap, sizeof(int32_t));
+        arena->seg_q_by_nms = (int8_t *)calloc(nn_ctx->max_obj_num, PROTO_CHANNEL);
+        arena->seg_zp_by_nms = (int32_t *)calloc(nn_ctx->max_obj_num, sizeof(int32_t));
+        if (!arena->boxes || !arena->segments || !arena->probs || !arena->class_id ||
+            !arena->heap || !arena->keep_buf || !arena->seg_by_nms || !arena->segments_q ||
+            !arena->seg_zp || !arena->seg_q_by_nms || !arena->seg_zp_by_nms) {
+            mpp_err_f("malloc candidate arena of %d failed!\n", arena->cap);
+            return -1;
+        }
+
+        {
+            NmsKeep *keep = &arena->keep;
+            int stride = MPP_ALIGN(nn_ctx->max_obj_num, 4);
+
+            keep->x1 = arena->keep_buf;
+            keep->y1 = keep->x1 + stride;
+            keep->x2 = keep->y1 + stride;
+            keep->y2 = keep->x2 + stride;
+            keep->area = keep->y2 + stride;
+            /* decoded boxes may stick out of the model input by the biggest anchor */
+            keep->offset = 4.0f * MPP_MAX(nn_ctx->model_width, nn_ctx->model_height);
+        }
+        post_dbg_detail("candidate arena capacity %d\n", arena->cap);
+    }
+
+    {
+        /*
+         * The stages on this pool are the DECODE_HEAD_NUM heads and the proto
+         * lut, which is cut into one slice per thread. The heads bound the
+         * useful thread count, and the caller is one of those threads.
+         */
+        long cpu_num = sysconf(_SC_NPROCESSORS_ONLN);
+        int thread_num = (int)MPP_MIN((long)DECODE_HEAD_NUM, cpu_num) - 1;
+
+        nn_ctx->decode_pool = worker_pool_create(MPP_MAX(thread_num, 0));
+        if (!nn_ctx->decode_pool) {
+            mpp_err_f("create decode pool failed!\n");
+            return -1;
+        }
+        /* the little cores of RK3588 only slow the slices down */
+        thread_num = worker_pool_pin_big_cores(nn_ctx->decode_pool);
+        post_dbg_detail("decode on %d threads, workers pinned to %d cores\n",
+                        worker_pool_thread_num(nn_ctx->decode_pool), thread_num);
+
+        /* the block map scales with the big cores, or every core when they are alike */
+        thread_num = worker_pool_big_core_num();
+        thread_num = (thread_num ? thread_num : (int)cpu_num) - 1;
+        nn_ctx->blk_pool = worker_pool_create(MPP_MAX(thread_num, 0));
+        if (!nn_ctx->blk_pool) {
+            mpp_err_f("create block map pool failed!\n");
+            return -1;
+        }
+        worker_pool_pin_big_cores(nn_ctx->blk_pool);
+        post_dbg_detail("block map on %d threads\n", worker_pool_thread_num(nn_ctx->blk_pool));
+    }
+
+    setup_class_set(nn_ctx);
+    setup_proto_lut(nn_ctx);
+    mpp_log("nn decode %d classes%s\n", nn_ctx->class_num, nn_ctx->class_only ? " only" : "");
+
     nn_ctx->proto = (float *)calloc(1, PROTO_CHANNEL * PROTO_HEIGHT * PROTO_WEIGHT * sizeof(float));
     if (!nn_ctx->proto) {
         mpp_err_f("malloc nn_ctx->proto failed!\n");
@@ -1180,10 +1834,24 @@ int init_post_process(RknnCtx *nn_ctx)
         return -1;
     }
 
+#ifndef ENABLE_NEON
+    nn_ctx->proto_q = (int8_t *)calloc(PROTO_HEIGHT * PROTO_WEIGHT, PROTO_CHANNEL);
+    nn_ctx->proto_q_sum = (int32_t *)calloc(PROTO_HEIGHT * PROTO_WEIGHT, sizeof(int32_t));
+    if (!nn_ctx->proto_q || !nn_ctx->proto_q_sum) {
+        mpp_err_f("malloc nn_ctx->proto_q failed!\n");
+        return -1;
+    }
+#endif
+
+#if defined(USE_FP_RESIZE) && !defined(ENABLE_MATMUL_OPT)
+    int matmul_planes = nn_ctx->max_obj_num; /* matmul_by_npu_fp() returns every box */
+#else
+    int matmul_planes = 1;
+#endif
 #if defined(USE_FP_RESIZE) && defined(USE_FP_MASK_MAP)
-    nn_ctx->matmul_out = (float *)calloc(1, OBJ_NUMB_MAX_SIZE * PROTO_HEIGHT * PROTO_WEIGHT * sizeof(float));
+    nn_ctx->matmul_out = (float *)calloc(1, matmul_planes * PROTO_HEIGHT * PROTO_WEIGHT * sizeof(float));
 #else
-    nn_ctx->matmul_out = (uint8_t *)calloc(1, OBJ_NUMB_MAX_SIZE * PROTO_HEIGHT * PROTO_WEIGHT * sizeof(uint8_t));
+    nn_ctx->matmul_out = (uint8_t *)calloc(1, matmul_planes * PROTO_HEIGHT * PROTO_WEIGHT * sizeof(uint8_t));
 #endif
     if (!nn_ctx->matmul_out) {
         mpp_err_f("malloc nn_ctx->matmul_out failed!\n");
@@ -1203,20 +1871,20 @@ int init_post_process(RknnCtx *nn_ctx)
         info.AC_layout = RKNN_MM_LAYOUT_NORM;
 
         timer.tik();
-        for (int i = 0; i < OBJ_NUMB_MAX_SIZE; ++i) {
+        for (int i = 0; i < nn_ctx->max_obj_num; ++i) {
             nn_ctx->shapes[i].M = i + 1;
             nn_ctx->shapes[i].K = PROTO_CHANNEL;
             nn_ctx->shapes[i].N = PROTO_HEIGHT * PROTO_WEIGHT;
         }
 
         ret = rknn_matmul_create_dynamic_shape(&nn_ctx->matmul_ctx, &info,
-                                               OBJ_NUMB_MAX_SIZE, nn_ctx->shapes, nn_ctx->io_attr);
+                                               nn_ctx->max_obj_num, nn_ctx->shapes, nn_ctx->io_attr);
         if (ret < 0) {
             mpp_log("rknn_matmul_create_dynamic_shape fail! ret=%d\n", ret);
             return -1;
         }
 
-        for (int i = 0; i < OBJ_NUMB_MAX_SIZE; ++i) {
+        for (int i = 0; i < nn_ctx->max_obj_num; ++i) {
             max_size_a = MPP_MAX(nn_ctx->io_attr[i].A.size, max_size_a);
             max_size_b = MPP_MAX(nn_ctx->io_attr[i].B.size, max_size_b);
             max_size_c = MPP_MAX(nn_ctx->io_attr[i].C.size, max_size_c);
@@ -1243,33 +1911,28 @@ int init_post_process(RknnCtx *nn_ctx)
         }
         post_dbg_matrix("tensor_a size %d tensor_b size %d tensor_c size %d\n",
                         nn_ctx->tensor_a->size, nn_ctx->tensor_b->size, nn_ctx->tensor_c->size);
-        post_dbg_time("rknn_matmul_create_dynamic_shape");
+        timer.tok();
+        mpp_log("rknn_matmul_create_dynamic_shape %d shapes: %0.2f ms\n",
+                nn_ctx->max_obj_num, timer.get_time());
     }
 #endif
 
-#if defined(USE_FP_RESIZE) && defined(USE_FP_MASK_MAP)
-    nn_ctx->seg_mask = (float *)calloc(1, OBJ_NUMB_MAX_SIZE * nn_ctx->model_width * nn_ctx->model_width * sizeof(float));
-#else
-    nn_ctx->seg_mask = (uint8_t *)calloc(1, OBJ_NUMB_MAX_SIZE * nn_ctx->model_width * nn_ctx->model_width * sizeof(uint8_t));
-#endif
-    if (!nn_ctx->seg_mask) {
-        mpp_err_f("malloc nn_ctx->seg_mask failed!\n");
+#ifdef ENABLE_MASK_BITS
+    nn_ctx->mask_bits_stride = MPP_ALIGN(nn_ctx->model_width, 64) / 64;
+    nn_ctx->mask_bits = (uint64_t *)calloc(nn_ctx->model_height * nn_ctx->mask_bits_stride, sizeof(uint64_t));
+    if (!nn_ctx->mask_bits) {
+        mpp_err_f("malloc nn_ctx->mask_bits failed!\n");
         return -1;
     }
-
+#else
     nn_ctx->all_mask_in_one = (uint8_t *)calloc(1, nn_ctx->model_height * nn_ctx->model_width * sizeof(uint8_t));
     if (!nn_ctx->all_mask_in_one) {
         mpp_err_f("malloc nn_ctx->all_mask_in_one failed!\n");
         return -1;
     }
+#endif
 
-    nn_ctx->cropped_seg_mask = (uint8_t *)calloc(1, nn_ctx->model_height * nn_ctx->model_width * sizeof(uint8_t));
-    if (!nn_ctx->cropped_seg_mask) {
-        mpp_err_f("malloc nn_ctx->cropped_seg_mask failed!\n");
-        return -1;
-    }
-
-    if (nn_ctx->pre_alloc_mask) {
+    if (nn_ctx->pre_alloc_mask && nn_ctx->full_mask_en) {
         nn_ctx->real_seg_mask = (uint8_t *)calloc(1, nn_ctx->input_image_height * nn_ctx->input_image_width * sizeof(uint8_t));
         if (!nn_ctx->real_seg_mask) {
             mpp_err_f("malloc nn_ctx->real_seg_mask failed!\n");
@@ -1301,6 +1964,49 @@ void deinit_post_process(RknnCtx *nn_ctx)
         nn_ctx->vector_b = nullptr;
     }
 
+    if (nn_ctx->proto_q) {
+        free(nn_ctx->proto_q);
+        nn_ctx->proto_q = nullptr;
+    }
+
+    if (nn_ctx->proto_q_sum) {
+        free(nn_ctx->proto_q_sum);
+        nn_ctx->proto_q_sum = nullptr;
+    }
+
+    if (nn_ctx->decode_pool) {
+        worker_pool_destroy(nn_ctx->decode_pool);
+        nn_ctx->decode_pool = nullptr;
+    }
+
+    if (nn_ctx->blk_pool) {
+        worker_pool_destroy(nn_ctx->blk_pool);
+        nn_ctx->blk_pool = nullptr;
+    }
+
+    if (nn_ctx->cand_arena) {
+        CandArena *arena = (CandArena *)nn_ctx->cand_arena;
+
+        free(arena->boxes);
+        free(arena->segments);
+        free(arena->probs);
+        free(arena->class_id);
+        free(arena->heap);
+        free(arena->keep_buf);
+        free(arena->seg_by_nms);
+        free(arena->segments_q);
+        free(arena->seg_zp);
+        free(arena->seg_q_by_nms);
+        free(arena->seg_zp_by_nms);
+        free(arena);
+        nn_ctx->cand_arena = nullptr;
+    }
+
+    if (nn_ctx->cand_idx) {
+        free(nn_ctx->cand_idx);
+        nn_ctx->cand_idx = nullptr;
+    }
+
     if (nn_ctx->matmul_out) {
         free(nn_ctx->matmul_out);
         nn_ctx->matmul_out = nullptr;
@@ -1328,19 +2034,14 @@ void deinit_post_process(RknnCtx *nn_ctx)
     post_dbg_time("rknn_matmul_destroy");
 #endif
 
-    if (!nn_ctx->seg_mask) {
-        free(nn_ctx->seg_mask);
-        nn_ctx->seg_mask = nullptr;
-    }
-
-    if (!nn_ctx->all_mask_in_one) {
+    if (nn_ctx->all_mask_in_one) {
         free(nn_ctx->all_mask_in_one);
         nn_ctx->all_mask_in_one = nullptr;
     }
 
-    if (!nn_ctx->cropped_seg_mask) {
-        free(nn_ctx->cropped_seg_mask);
-        nn_ctx->cropped_seg_mask = nullptr;
+    if (nn_ctx->mask_bits) {
+        free(nn_ctx->mask_bits);
+        nn_ctx->mask_bits = nullptr;
     }
 
     if (nn_ctx->pre_alloc_mask && nn_ctx->real_seg_mask) {
@@ -6,6 +6,7 @@
 #include "rknn_matmul_api.h"
 #include "common.h"
 #include "image_utils.h"
+#include "worker_pool.h"
 
 // #ifndef RV1126B_ARMHF
 // #define RV1126B_ARMHF
@@ -128,6 +129,11 @@ typedef struct {
     int8_t is_quant;
     image_buffer_t *dst_img;
 
+    int8_t zero_copy; /* 0 or 1, input/output tensors bound by rknn_set_io_mem */
+    rknn_tensor_mem *input_mem; /* wraps dst_img, letterbox writes to npu input directly */
+    rknn_tensor_mem **output_mems; /* io_num.n_output npu output buffers */
+
+    int max_obj_num; /* [1, OBJ_NUMB_MAX_SIZE], objects kept after nms and matmul shapes created */
     rknn_matmul_ctx matmul_ctx;
     rknn_matmul_shape shapes[OBJ_NUMB_MAX_SIZE];
     rknn_matmul_io_attr io_attr[OBJ_NUMB_MAX_SIZE];
@@ -136,24 +142,55 @@ typedef struct {
     rknn_tensor_mem *tensor_c;
 
 #if defined(USE_FP_RESIZE) && defined(USE_FP_MASK_MAP)
-    float *matmul_out; /* C = A * B */
-    float *seg_mask; /* 640x640 * N, resize from 160x160 */
+    float *matmul_out; /* C = A * B, one 160x160 plane per box at most */
 #else
-    uint8_t *matmul_out; /* C = A * B */
-    uint8_t *seg_mask; /* 640x640 * N, resize from 160x160 */
+    uint8_t *matmul_out; /* C = A * B, 0/1 160x160 of the current box or the merged boxes */
 #endif
-    uint8_t *all_mask_in_one; /* 640x640, all object mask in one image */
-    uint8_t *cropped_seg_mask; /* max is 640x640. 640x360 if input is 1920x1080 */
+    uint8_t *all_mask_in_one; /* 640x640, all object mask in one image, NULL when mask_bits is used */
+    uint64_t *mask_bits; /* 0/1 all_mask_in_one of the merged mask, pixel x of a row at bit x % 64 of word x / 64 */
+    int mask_bits_stride; /* words per mask_bits row */
     uint8_t *real_seg_mask; /* width * height, real seg mask of org picture */
     uint8_t pre_alloc_mask; /* 0 or 1, pre allocate mask memory or not */
-
+    int full_mask_en; /* 1 - block map from the input resolution mask, 0 - blocks projected on all_mask_in_one */
+    uint16_t *proj_x; /* all_mask_in_one column of each input column */
+    uint16_t *proj_y; /* all_mask_in_one row of each input row */
+    int proj_w; /* input size and padding proj_x/proj_y are built for */
+    int proj_h;
+    int proj_pad_x;
+    int proj_pad_y;
+    uint8_t *blk_class; /* class of each 16x16 block of the input in raster order */
+    uint32_t *band_cnt; /* per label column counts of one row of blocks, prefixed along x, one per thread */
+    int blk_w; /* blocks per row and column blk_class is allocated for */
+    int blk_h;
+    int band_cnt_w; /* columns + 1 of band_cnt */
+    int band_cnt_num; /* threads band_cnt is allocated for */
+    uint32_t *ctu_order; /* encoder order index of each 16x16 block in raster order */
+    int ctu_order_w; /* picture size and ctu size ctu_order is built for */
+    int ctu_order_h;
+    int ctu_order_ctu;
+
+    int *cand_idx; /* grid cells passing the confidence scan, cand_grid_max for each head */
+    int cand_grid_max;
+    void *cand_arena; /* decode candidates, see CandArena in postprocess.cpp */
+    int frame_alloc_num; /* post process and block map buffers malloc'ed in the last frame, 0 after the first one with pre_alloc_mask */
+    WorkerPool *decode_pool;
+    WorkerPool *blk_pool; /* block map slices, one thread for each big core */
     float *proto; /* proto mask */
     uint16_t *vector_b; /* float32 to float16 */
+    float proto_lut[256]; /* dequantized proto, indexed by the int8 value as uint8 */
+    uint16_t proto_lut_f16[256];
+    int8_t *proto_q; /* int8 proto as [pixel][channel] for the cpu matmul */
+    int32_t *proto_q_sum; /* channel sum of each proto_q pixel */
     float filterBoxes_by_nms[OBJ_NUMB_MAX_SIZE * 4];
     int cls_id[OBJ_NUMB_MAX_SIZE];
+    image_rect_t proto_rect[OBJ_NUMB_MAX_SIZE]; /* box footprint on the proto grid, right/bottom exclusive */
 
     int run_type;
     int scene_mode; /* pick different class for different scene */
+    int class_ids[OBJ_CLASS_NUM]; /* wanted classes, default by scene_mode if class_num is 0 */
+    int class_num;
+    uint8_t class_wanted[OBJ_CLASS_NUM]; /* 1 - class kept after decode */
+    uint8_t class_only; /* 1 - argmax over wanted classes only, skip other score planes */
     int segmap_calc_en; /* 0 or 1, enable segmap calculation or not */
     int show_time_lvl;
     FILE *fp_segmap;
@@ -164,7 +201,8 @@ typedef struct
 {
     int found_objects;
     int foreground_area; /* [0, 100] */
-    uint8_t *object_seg_map;
+    uint8_t *object_seg_map; /* one byte for each 16x16 block in encoder order */
+    size_t object_seg_map_size; /* bytes allocated for object_seg_map */
 } object_map_result_list;
 
 typedef struct
@@ -0,0 +1,223 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* pthread_setaffinity_np */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "worker_pool.h"
+#include "mpp_log.h"
+
+struct WorkerPool_t {
+    pthread_t *threads;
+    int thread_num;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond_start;
+    pthread_cond_t cond_done;
+
+    /* current job, protected by lock */
+    WorkerTask task;
+    void *arg;
+    int task_num;
+    int task_next;
+    int task_done;
+    unsigned int generation;
+    int quit;
+};
+
+/* take tasks until none is left, called with lock held */
+static void worker_pool_drain(WorkerPool *pool)
+{
+    while (pool->task_next < pool->task_num) {
+        int idx = pool->task_next++;
+
+        pthread_mutex_unlock(&pool->lock);
+        pool->task(pool->arg, idx);
+        pthread_mutex_lock(&pool->lock);
+
+        if (++pool->task_done == pool->task_num)
+            pthread_cond_signal(&pool->cond_done);
+    }
+}
+
+static void *worker_pool_thread(void *ctx)
+{
+    WorkerPool *pool = (WorkerPool *)ctx;
+    unsigned int seen;
+
+    pthread_mutex_lock(&pool->lock);
+    seen = pool->generation;
+    while (1) {
+        while (!pool->quit && pool->generation == seen)
+            pthread_cond_wait(&pool->cond_start, &pool->lock);
+
+        if (pool->quit)
+            break;
+
+        seen = pool->generation;
+        worker_pool_drain(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+WorkerPool *worker_pool_create(int thread_num)
+{
+    WorkerPool *pool = (WorkerPool *)calloc(1, sizeof(WorkerPool));
+
+    if (!pool) {
+        mpp_err_f("malloc worker pool failed\n");
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond_start, NULL);
+    pthread_cond_init(&pool->cond_done, NULL);
+
+    if (thread_num > 0) {
+        pool->threads = (pthread_t *)calloc(thread_num, sizeof(pthread_t));
+        if (!pool->threads) {
+            mpp_err_f("malloc %d worker threads failed\n", thread_num);
+            worker_pool_destroy(pool);
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < thread_num; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_pool_thread, pool)) {
+            mpp_err_f("create worker thread %d failed\n", i);
+            break;
+        }
+        pool->thread_num++;
+    }
+
+    return pool;
+}
+
+void worker_pool_run(WorkerPool *pool, WorkerTask task, void *arg, int task_num)
+{
+    if (!pool || !pool->thread_num || task_num <= 1) {
+        for (int i = 0; i < task_num; i++)
+            task(arg, i);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->task_num = task_num;
+    pool->task_next = 0;
+    pool->task_done = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->cond_start);
+
+    /* the caller works too instead of just waiting */
+    worker_pool_drain(pool);
+    while (pool->task_done < pool->task_num)
+        pthread_cond_wait(&pool->cond_done, &pool->lock);
+    pool->task_num = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* cpus above the lowest cpuinfo_max_freq, 0 when all cpus are alike or it is unknown */
+static int big_core_set(cpu_set_t *set)
+{
+    long cpu_num = sysconf(_SC_NPROCESSORS_CONF);
+    long freq[CPU_SETSIZE];
+    long max = 0, min = 0;
+    int i;
+
+    if (cpu_num <= 0 || cpu_num > CPU_SETSIZE)
+        return 0;
+
+    for (i = 0; i < cpu_num; i++) {
+        char path[64];
+        FILE *fp;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", i);
+        fp = fopen(path, "r");
+        if (!fp)
+            return 0;
+        if (fscanf(fp, "%ld", &freq[i]) != 1)
+            freq[i] = 0;
+        fclose(fp);
+
+        if (freq[i] <= 0)
+            return 0;
+        if (!max || freq[i] > max)
+            max = freq[i];
+        if (!min || freq[i] < min)
+            min = freq[i];
+    }
+
+    if (max == min)
+        return 0;
+
+    /* the big clusters of RK3588 may report different maximums, only the little one is left out */
+    CPU_ZERO(set);
+    for (i = 0; i < cpu_num; i++) {
+        if (freq[i] > min)
+            CPU_SET(i, set);
+    }
+
+    return CPU_COUNT(set);
+}
+
+int worker_pool_big_core_num(void)
+{
+    cpu_set_t set;
+
+    return big_core_set(&set);
+}
+
+int worker_pool_pin_big_cores(WorkerPool *pool)
+{
+    cpu_set_t set;
+    int cpu_num;
+
+    if (!pool || !pool->thread_num)
+        return 0;
+
+    cpu_num = big_core_set(&set);
+    if (!cpu_num)
+        return 0;
+
+    for (int i = 0; i < pool->thread_num; i++) {
+        if (pthread_setaffinity_np(pool->threads[i], sizeof(set), &set)) {
+            mpp_err_f("pin worker thread %d failed\n", i);
+            return 0;
+        }
+    }
+
+    return cpu_num;
+}
+
+int worker_pool_thread_num(WorkerPool *pool)
+{
+    return pool ? pool->thread_num + 1 : 1;
+}
+
+void worker_pool_destroy(WorkerPool *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->cond_start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_num; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->cond_done);
+    pthread_cond_destroy(&pool->cond_start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
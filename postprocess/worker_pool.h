@@ -0,0 +1,57 @@
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* run one task of index idx in [0, task_num) */
+typedef void (*WorkerTask)(void *arg, int idx);
+
+typedef struct WorkerPool_t WorkerPool;
+
+/**
+ * @brief create a pool of persistent worker threads
+ *
+ * @param thread_num [IN] worker threads besides the caller, 0 runs everything on the caller
+ * @return WorkerPool* NULL on failure
+ */
+WorkerPool *worker_pool_create(int thread_num);
+
+/**
+ * @brief run task_num tasks on the pool and the calling thread, return when all are done
+ *
+ * @param pool [IN] worker pool, NULL runs the tasks serially
+ * @param task [IN] task function
+ * @param arg [IN] task argument shared by all tasks
+ * @param task_num [IN] task number
+ */
+void worker_pool_run(WorkerPool *pool, WorkerTask task, void *arg, int task_num);
+
+/**
+ * @brief number of cores above the lowest max frequency (big cores of RK3588)
+ *
+ * @return int 0 if all cores are alike or it is unknown
+ */
+int worker_pool_big_core_num(void);
+
+/**
+ * @brief pin the worker threads to the cores above the lowest max frequency (big cores of RK3588)
+ *
+ * @param pool [IN] worker pool
+ * @return int number of cores the workers run on, 0 if not pinned (cores alike or unknown)
+ */
+int worker_pool_pin_big_cores(WorkerPool *pool);
+
+/**
+ * @brief number of threads working in worker_pool_run, caller included
+ */
+int worker_pool_thread_num(WorkerPool *pool);
+
+void worker_pool_destroy(WorkerPool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WORKER_POOL_H__ */
@@ -7,12 +7,100 @@
 #include "rknn_process.h"
 #include "super_enc_common.h"
 #include "mpp_log.h"
+#include "mpp_debug.h"
+#include "mpp_time.h"
 #include "mpp_common.h"
 #include "assert.h"
 #include "dma_alloc.hpp"
 
-#define SEG_OUT_CHN_NUM        (7)  /* rknn yolov5 seg output channel number */
-#define SEG_OUT_BUF_SIZE       (1632000)  /* rknn yolov5 seg output size */
+#define SEG_OUT_BUF_ALIGN      (64)  /* cache line, keep each output head on its own lines */
+
+static image_format_t get_image_format(MppFrameFormat fmt)
+{
+    if (MPP_FRAME_FMT_IS_FBC(fmt))
+        return IMAGE_FORMAT_BUTT;
+
+    switch (fmt & MPP_FRAME_FMT_MASK) {
+    case MPP_FMT_YUV420SP : return IMAGE_FORMAT_YUV420SP_NV12;
+    case MPP_FMT_YUV420SP_VU : return IMAGE_FORMAT_YUV420SP_NV21;
+    case MPP_FMT_YUV420P : return IMAGE_FORMAT_YUV420P;
+    case MPP_FMT_YUV422SP : return IMAGE_FORMAT_YUV422SP_NV16;
+    case MPP_FMT_YUV422SP_VU : return IMAGE_FORMAT_YUV422SP_NV61;
+    case MPP_FMT_YUV422P : return IMAGE_FORMAT_YUV422P;
+    case MPP_FMT_YUV422_YUYV : return IMAGE_FORMAT_YUV422_YUYV;
+    case MPP_FMT_YUV422_YVYU : return IMAGE_FORMAT_YUV422_YVYU;
+    case MPP_FMT_YUV422_UYVY : return IMAGE_FORMAT_YUV422_UYVY;
+    case MPP_FMT_YUV422_VYUY : return IMAGE_FORMAT_YUV422_VYUY;
+    case MPP_FMT_YUV400 : return IMAGE_FORMAT_GRAY8;
+    case MPP_FMT_RGB565 : return IMAGE_FORMAT_RGB565;
+    case MPP_FMT_BGR565 : return IMAGE_FORMAT_BGR565;
+    case MPP_FMT_RGB888 : return IMAGE_FORMAT_RGB888;
+    case MPP_FMT_BGR888 : return IMAGE_FORMAT_BGR888;
+    case MPP_FMT_ARGB8888 : return IMAGE_FORMAT_ARGB8888;
+    case MPP_FMT_ABGR8888 : return IMAGE_FORMAT_ABGR8888;
+    case MPP_FMT_BGRA8888 : return IMAGE_FORMAT_BGRA8888;
+    case MPP_FMT_RGBA8888 : return IMAGE_FORMAT_RGBA8888;
+    default : break;
+    }
+
+    return IMAGE_FORMAT_BUTT;
+}
+
+/* describe the stride-padded encoder input frame as nn source image */
+static MPP_RET setup_src_image(SuperEncCtx *sec, image_buffer_t *image)
+{
+    MpiEncTestArgs *cmd = sec->args;
+
+    image->format = get_image_format(cmd->format);
+    if (image->format == IMAGE_FORMAT_BUTT) {
+        mpp_err_f("nn input not support format 0x%x\n", cmd->format);
+        return MPP_NOK;
+    }
+
+    image->width = cmd->width;
+    image->height = cmd->height;
+    /* mpp hor_stride is counted in bytes, image width_stride in pixels */
+    image->width_stride = cmd->hor_stride / get_image_plane_bpp(image->format);
+    image->height_stride = cmd->ver_stride;
+    image->size = get_image_size(image);
+
+    return MPP_OK;
+}
+
+/* stage all rknn_outputs_get heads in one pool, each sized by its tensor attribute */
+static MPP_RET alloc_output_bufs(SuperEncCtx *sec)
+{
+    RknnCtx *nn_ctx = &sec->rknn_ctx;
+    rknn_output *outputs = sec->outputs;
+    RK_U32 n_output = nn_ctx->io_num.n_output;
+    size_t pool_size = 0;
+    size_t offset = 0;
+
+    for (RK_U32 i = 0; i < n_output; i++) {
+        rknn_tensor_attr *attr = &nn_ctx->output_attrs[i];
+
+        outputs[i].index = i;
+        outputs[i].want_float = (!nn_ctx->is_quant);
+        outputs[i].size = attr->n_elems * (outputs[i].want_float ? sizeof(float) : sizeof(int8_t));
+        outputs[i].is_prealloc = 1;
+        pool_size += MPP_ALIGN(outputs[i].size, SEG_OUT_BUF_ALIGN);
+    }
+
+    if (posix_memalign((void **)&sec->outputs_pool, SEG_OUT_BUF_ALIGN, pool_size)) {
+        sec->outputs_pool = NULL;
+        mpp_err_f("malloc output pool size %d failed\n", (int)pool_size);
+        return MPP_NOK;
+    }
+    memset(sec->outputs_pool, 0, pool_size);
+
+    for (RK_U32 i = 0; i < n_output; i++) {
+        outputs[i].buf = sec->outputs_pool + offset;
+        offset += MPP_ALIGN(outputs[i].size, SEG_OUT_BUF_ALIGN);
+    }
+    mpp_log("rknn %d outputs staged in %d bytes\n", n_output, (int)pool_size);
+
+    return MPP_OK;
+}
 
 static MPP_RET dump_detect_rectangle(RknnCtx *nn_ctx, object_detect_result_list *result, int frm_cnt)
 {
@@ -20,8 +108,7 @@ static MPP_RET dump_detect_rectangle(RknnCtx *nn_ctx, object_detect_result_list
 
     for (int k = 0; k < result->count; k++) {
         int class_id = result->results[k].cls_id;
-        if (class_id == LABEL_PERSON || class_id == LABEL_BICYCLE || class_id == LABEL_CAR ||
-            class_id == LABEL_MOTORCYCLE || class_id == LABEL_BUS) {
+        if (nn_ctx->class_wanted[class_id]) {
             fprintf(fp, "frame %d obj_num %d x %d y %d w %d h %d\n",
                     frm_cnt, result->count, result->results[k].box.left,
                     result->results[k].box.top,
@@ -49,67 +136,56 @@ static MPP_RET adjust_detect_rectangle_coordinate(RknnCtx *nn_ctx, object_detect
     return MPP_OK;
 }
 
-/* return 1 if detect object, 0 if no detect object */
-static int get_dectect_flag(RknnCtx *nn_ctx, object_detect_result_list *result, int pos_x, int pos_y)
-{
-    int x, y, w, h;
-    int flag = 0;
-
-    for (int k = 0; k < result->count; k++) {
-        int class_id = result->results[k].cls_id;
-        if (class_id == LABEL_PERSON || class_id == LABEL_BICYCLE || class_id == LABEL_CAR ||
-            class_id == LABEL_MOTORCYCLE || class_id == LABEL_BUS) {
-            x = result->results[k].box.left;
-            y = result->results[k].box.top;
-            w = result->results[k].box.right - result->results[k].box.left;
-            h = result->results[k].box.bottom - result->results[k].box.top;
-            if (pos_x >= x && pos_x < x + w && pos_y >= y && pos_y < y + h) {
-                flag = 1;
-                break;
-            }
-        }
-    }
-
-    return flag;
-}
-
+/*
+ * A block is foreground when its top left pixel is inside a box of a wanted
+ * class. Boxes are rasterised over the blocks they cover, so the cost follows
+ * the covered area rather than blocks x boxes.
+ */
 static MPP_RET trans_rectangle_to_segmap(RknnCtx *nn_ctx, object_detect_result_list *od_results,
                                          object_map_result_list *object_results, uint8_t ctu_size, int frame_count)
 {
-    int i, j;
-    int h, w, block_num, pos_idx;
-    int blk_pos_x, blk_pos_y, blk_end_x, blk_end_y;
     int pic_width = nn_ctx->input_image_width;
     int pic_height = nn_ctx->input_image_height;
+    int blk_w = (pic_width + 15) / 16;
     uint8_t *object_map = object_results->object_seg_map;
-    uint8_t *seg_mask = od_results->results_seg[0].seg_mask;
     int b16_num = MPP_ALIGN(pic_width, ctu_size) / 16 * MPP_ALIGN(pic_height, ctu_size) / 16;
     int fg_b16_num = 0;
-    int bg_fg_flag = 0; /* 0 - background, 1 - foreground */
 
-    block_num = 0;
+    /* built on the first frame whatever it holds, later frames of the same size reuse it */
+    if (setup_ctu_order(nn_ctx, pic_width, pic_height, ctu_size))
+        return MPP_NOK;
+
     // if more than one object, we need to convert the object map
     if (od_results->count >= 1) {
         object_results->found_objects = 1;
+        memset(object_map, 0, b16_num);
+
+        for (int k = 0; k < od_results->count; k++) {
+            image_rect_t *box = &od_results->results[k].box;
+            int bx0, bx1, by0, by1;
 
-        for (h = 0; h < pic_height; h += ctu_size) {
-            for (w = 0; w < pic_width; w += ctu_size) {
-                for (i = 0; i < ctu_size / 16; i++) {
-                    for (j = 0; j < ctu_size / 16; j++) {
-                        blk_pos_x = w + j * 16;
-                        blk_pos_y = h + i * 16;
-
-                        bg_fg_flag = get_dectect_flag(nn_ctx, od_results, blk_pos_x, blk_pos_y);
-                        object_map[block_num] = (blk_pos_x > pic_width || blk_pos_y > pic_height) ? 0 : bg_fg_flag;
-                        fg_b16_num += (object_map[block_num] >= 1);
-                        if (bg_fg_flag || (block_num == b16_num - 1))
-                            FPRINT(nn_ctx->fp_segmap, "frame %d blk_idx %d (%d, %d) object_map %d\n",
-                                   frame_count, block_num, blk_pos_x, blk_pos_y, bg_fg_flag);
-                        block_num++;
-                    }
+            if (!nn_ctx->class_wanted[od_results->results[k].cls_id])
+                continue;
+
+            /* blocks whose top left pixel is in [left, right) x [top, bottom) */
+            if (box->right <= 0 || box->bottom <= 0 || box->right <= box->left || box->bottom <= box->top)
+                continue;
+            bx0 = (MPP_MAX(box->left, 0) + 15) / 16;
+            by0 = (MPP_MAX(box->top, 0) + 15) / 16;
+            bx1 = MPP_MIN((box->right - 1) / 16, (pic_width - 1) / 16);
+            by1 = MPP_MIN((box->bottom - 1) / 16, (pic_height - 1) / 16);
+
+            for (int by = by0; by <= by1; by++) {
+                for (int bx = bx0; bx <= bx1; bx++) {
+                    uint8_t *blk = &object_map[nn_ctx->ctu_order[by * blk_w + bx]];
+
+                    fg_b16_num += !*blk;
+                    *blk = 1;
                 }
             }
         }
+
+        dump_object_map(nn_ctx, object_map, pic_width, pic_height, ctu_size, frame_count);
     } else if (nn_ctx->fp_segmap) {
         /* for nn result debug */
         FPRINT(nn_ctx->fp_segmap, "frame %d blk_idx %d (0, 0) object_map 0\n", frame_count, b16_num - 1);
@@ -126,6 +202,8 @@ MPP_RET super_enc_rknn_init(SuperEncCtx *sec)
     RknnCtx *nn_ctx = &sec->rknn_ctx;
     object_map_result_list *om_results = &sec->om_results;
     image_buffer_t *image = &sec->src_image;
+    RK_S64 time_start = mpp_time();
+    RK_S64 time_model, time_bind;
 
     nn_ctx->run_type = sec->args->run_type;
     nn_ctx->scene_mode = sec->args->yolo_scene_mode;
@@ -133,12 +211,19 @@ MPP_RET super_enc_rknn_init(SuperEncCtx *sec)
     nn_ctx->fp_rect = sec->fp_nn_dect_rect;
     nn_ctx->segmap_calc_en = !sec->args->rect_to_segmap_en;
     nn_ctx->show_time_lvl = sec->args->show_time;
+    nn_ctx->max_obj_num = sec->args->nn_max_obj;
+    nn_ctx->class_only = sec->args->nn_cls_only;
+    nn_ctx->full_mask_en = sec->args->nn_full_mask;
+    nn_ctx->class_num = sec->args->nn_cls_num;
+    for (int i = 0; i < sec->args->nn_cls_num; i++)
+        nn_ctx->class_ids[i] = sec->args->nn_cls[i];
 
     ret = (MPP_RET)init_yolov5_seg_model(sec->args->model_path, nn_ctx);
     if (ret != MPP_OK) {
         mpp_err_f("init yolov5 seg model failed\n");
         return ret;
     }
+    time_model = mpp_time();
 
     if (sec->args->run_type != RUN_JPEG_RKNN &&
         sec->args->run_type != RUN_JPEG_RKNN_MPP) {
@@ -148,48 +233,23 @@ MPP_RET super_enc_rknn_init(SuperEncCtx *sec)
         nn_ctx->input_image_height = sec->args->height;
     }
 
-    assert(nn_ctx->io_num.n_output == SEG_OUT_CHN_NUM);
-    for (int i = 0; i < SEG_OUT_CHN_NUM; i++) {
-        sec->outputs[i].index = i;
-        sec->outputs[i].want_float = (!nn_ctx->is_quant);
-        sec->outputs[i].size = SEG_OUT_BUF_SIZE;
-        sec->outputs[i].is_prealloc = 1;
-
-        if (sec->outputs[i].is_prealloc) {
-            sec->outputs[i].buf = calloc(1, sec->outputs[i].size);
-            if (!sec->outputs[i].buf) {
-                mpp_err_f("malloc output buf failed\n");
-                return MPP_NOK;
-            }
-        }
-    }
-
     om_results->found_objects = 0;
-    if (sec->args->run_type != RUN_JPEG_RKNN && sec->args->run_type != RUN_JPEG_RKNN_MPP) {
-        RK_S32 w = MPP_ALIGN(sec->args->width, 64);
-        RK_S32 h = MPP_ALIGN(sec->args->height, 64);
-        om_results->object_seg_map = (uint8_t *)calloc(1, w * h); //TODO: one byte for blk16(2025.02.26)
-        if (!om_results->object_seg_map) {
-            mpp_err_f("malloc object_seg_map(%dx%d) failed\n", w, h);
-            return MPP_NOK;
-        }
-    }
+
+    ret = setup_src_image(sec, image);
+    if (ret != MPP_OK)
+        return ret;
 
     if (sec->soc_name == SOC_RK3588) {
         image_buffer_t *src = &sec->src_image;
         image_buffer_t *dst = &sec->dst_image;
 
-        src->width = sec->args->width;
-        src->height = sec->args->height;
-        src->format = (sec->args->format == MPP_FMT_YUV420P) ? IMAGE_FORMAT_YUV420P :
-                        IMAGE_FORMAT_YUV420SP_NV12; //TODO: support other format(2025.02.24)
-        src->size = src->width * src->height * get_bpp_from_format(src->format);
         src->use_dma32_buf = 1;
 
         dst->width = nn_ctx->model_width;
         dst->height = nn_ctx->model_height;
+        dst->width_stride = nn_ctx->input_attrs[0].w_stride;
         dst->format = IMAGE_FORMAT_RGB888;
-        dst->size = dst->width * dst->height * get_bpp_from_format(dst->format);
+        dst->size = get_image_size(dst);
         dst->use_dma32_buf = 1;
 
         /*
@@ -208,12 +268,33 @@ MPP_RET super_enc_rknn_init(SuperEncCtx *sec)
         nn_ctx->dst_img = dst;
     }
 
+    sec->outputs = (rknn_output *)calloc(nn_ctx->io_num.n_output, sizeof(rknn_output));
+    if (!sec->outputs) {
+        mpp_err_f("malloc %d outputs failed\n", nn_ctx->io_num.n_output);
+        return MPP_NOK;
+    }
+
+    /* letterbox into the npu input and read outputs in place, no per frame copy */
+    if (bind_yolov5_seg_io_mem(nn_ctx, &sec->dst_image, sec->outputs) == ROCKIVA_RET_SUCCESS) {
+        nn_ctx->dst_img = &sec->dst_image;
+    } else {
+        mpp_log("rknn zero copy unavailable, use rknn_outputs_get\n");
+        ret = alloc_output_bufs(sec);
+        if (ret != MPP_OK)
+            return ret;
+    }
+    time_bind = mpp_time();
+
     ret = (MPP_RET)init_post_process(nn_ctx);
     if (ret != MPP_OK) {
         mpp_err_f("init post process failed\n");
         return ret;
     }
 
+    mpp_log("rknn startup %0.2f ms: model %0.2f ms, buffers %0.2f ms, post process %0.2f ms\n",
+            (float)(mpp_time() - time_start) / 1000, (float)(time_model - time_start) / 1000,
+            (float)(time_bind - time_model) / 1000, (float)(mpp_time() - time_bind) / 1000);
+
     return ret;
 }
 
@@ -224,6 +305,7 @@ MPP_RET super_enc_rknn_process(SuperEncCtx *sec)
     image_buffer_t *image = &sec->src_image;
     MPP_RET ret = MPP_OK;
     RK_S32 ctu_size = 16;
+    ObjMap *obj_map;
 
     if (sec->soc_name != SOC_RK3588)
         memset(image, 0, sizeof(image_buffer_t));
@@ -234,24 +316,17 @@ MPP_RET super_enc_rknn_process(SuperEncCtx *sec)
             mpp_err_f("read image failed\n");
             return ret;
         }
-
-        sec->om_results.object_seg_map = (uint8_t *)calloc(1, image->height * image->width);
-        if (!sec->om_results.object_seg_map) { //TODO: one byte for blk16(2025.02.26)
-            mpp_err_f("malloc object_seg_map(%dx%d) failed\n", image->width, image->height);
-            return MPP_NOK;
-        }
     } else {
         /* input yuv data */
         if (sec->soc_name == SOC_RK3588) {
-            //TODO: copy size, support other format(20250409)
-            memcpy(image->virt_addr, sec->src_buf, sec->args->width * sec->args->height * 3 / 2);
+            /* rga on 3588 needs dma32 buffer, copy the whole stride-padded frame at once */
+            memcpy(image->virt_addr, sec->src_buf, image->size);
         } else {
-            image->width = sec->args->width;
-            image->height = sec->args->height;
-            image->format = (sec->args->format == MPP_FMT_YUV420P) ? IMAGE_FORMAT_YUV420P :
-                            IMAGE_FORMAT_YUV420SP_NV12; //TODO: support other format(2025.02.24)
+            /* feed the encoder input buffer to rga directly, no repacking */
+            ret = setup_src_image(sec, image);
+            if (ret != MPP_OK)
+                return ret;
             image->virt_addr = sec->src_buf;
-            image->size = sec->args->width * sec->args->height * 3 / 2;
         }
     }
 
@@ -276,6 +351,20 @@ MPP_RET super_enc_rknn_process(SuperEncCtx *sec)
     ctu_size = (sec->args->type == MPP_VIDEO_CodingAVC) ? 16 :
                (sec->soc_name == SOC_RK3576) ? 32 : 64;
 
+    /*
+     * One byte for each 16x16 block of the picture aligned to the largest ctu,
+     * so the map fits every ctu size. Maps of the ring only grow.
+     */
+    obj_map = obj_map_ring_acquire(&sec->obj_maps,
+                                   MPP_ALIGN(nn_ctx->input_image_width, 64) / 16 *
+                                   MPP_ALIGN(nn_ctx->input_image_height, 64) / 16, sec->frame_count);
+    if (!obj_map) {
+        mpp_err_f("malloc object_seg_map(%dx%d) failed\n", nn_ctx->input_image_width, nn_ctx->input_image_height);
+        return MPP_NOK;
+    }
+    sec->om_results.object_seg_map = obj_map->map;
+    sec->om_results.object_seg_map_size = obj_map->size;
+
     if (sec->args->rect_to_segmap_en)
         ret = trans_rectangle_to_segmap(nn_ctx, &sec->od_results,
                         &sec->om_results, ctu_size, sec->frame_count);
@@ -284,9 +373,20 @@ MPP_RET super_enc_rknn_process(SuperEncCtx *sec)
                         &sec->om_results, ctu_size, sec->frame_count);
     if (ret != MPP_OK) {
         mpp_err_f("seg mask to class map failed\n");
+        obj_map_ring_put(&sec->obj_maps, obj_map);
         return ret;
     }
 
+    /* the input size is fixed with pre_alloc_mask, every buffer exists after the first frame */
+    if (nn_ctx->pre_alloc_mask && sec->frame_count > 0)
+        mpp_assert(!nn_ctx->frame_alloc_num);
+
+    obj_map->foreground_area = sec->om_results.foreground_area;
+    /* the encoder holds the map until the packet of this frame comes back */
+    if (sec->args->run_type != RUN_JPEG_RKNN && sec->args->run_type != RUN_YUV_RKNN)
+        obj_map_ring_ref(&sec->obj_maps, obj_map);
+    obj_map_ring_put(&sec->obj_maps, obj_map);
+
     mpp_log("frame %d rknn found %d objects fg_area %d%\n",
             sec->frame_count, sec->od_results.count,
             sec->om_results.foreground_area);
@@ -296,13 +396,15 @@ MPP_RET super_enc_rknn_process(SuperEncCtx *sec)
 
 MPP_RET super_enc_rknn_release(SuperEncCtx *sec)
 {
-    rknn_output *outputs = sec->outputs;
     object_map_result_list *om_results = &sec->om_results;
 
-    for (int i = 0; i < SEG_OUT_CHN_NUM; i++)
-        SE_FREE(outputs[i].buf);
+    /* zero copy outputs belong to the rknn context, staged ones to the pool */
+    SE_FREE(sec->outputs_pool);
+    SE_FREE(sec->outputs);
 
-    SE_FREE(om_results->object_seg_map);
+    /* the maps belong to sec->obj_maps */
+    om_results->object_seg_map = NULL;
+    om_results->object_seg_map_size = 0;
 
     if (sec->args->run_type == RUN_JPEG_RKNN || sec->args->run_type == RUN_JPEG_RKNN_MPP)
         SE_FREE(sec->src_image.virt_addr);
@@ -1,4 +1,95 @@
 #include "super_enc_common.h"
 
+int obj_map_ring_init(ObjMapRing *ring)
+{
+    memset(ring, 0, sizeof(*ring));
 
+    if (pthread_mutex_init(&ring->lock, NULL))
+        return -1;
 
+    if (pthread_cond_init(&ring->cond, NULL)) {
+        pthread_mutex_destroy(&ring->lock);
+        return -1;
+    }
+
+    return 0;
+}
+
+void obj_map_ring_deinit(ObjMapRing *ring)
+{
+    int i;
+
+    for (i = 0; i < OBJ_MAP_RING_SIZE; i++) {
+        SE_FREE(ring->maps[i].map);
+        ring->maps[i].size = 0;
+    }
+
+    pthread_cond_destroy(&ring->cond);
+    pthread_mutex_destroy(&ring->lock);
+}
+
+ObjMap *obj_map_ring_acquire(ObjMapRing *ring, size_t size, int frame_idx)
+{
+    ObjMap *map;
+
+    pthread_mutex_lock(&ring->lock);
+    map = &ring->maps[ring->next];
+    /* maps go back in frame order, so waiting on the oldest one is enough */
+    while (map->ref)
+        pthread_cond_wait(&ring->cond, &ring->lock);
+    pthread_mutex_unlock(&ring->lock);
+
+    /* nobody else touches a map with no holder */
+    if (map->size < size) {
+        SE_FREE(map->map);
+        map->size = 0;
+        map->map = (uint8_t *)malloc(size);
+        if (!map->map)
+            return NULL;
+        map->size = size;
+    }
+
+    /* a frame without objects does not write the map */
+    memset(map->map, 0, map->size);
+    map->foreground_area = 0;
+
+    pthread_mutex_lock(&ring->lock);
+    map->frame_idx = frame_idx;
+    map->ref = 1;
+    ring->next = (ring->next + 1) % OBJ_MAP_RING_SIZE;
+    pthread_mutex_unlock(&ring->lock);
+
+    return map;
+}
+
+ObjMap *obj_map_ring_find(ObjMapRing *ring, int frame_idx)
+{
+    ObjMap *map = NULL;
+    int i;
+
+    pthread_mutex_lock(&ring->lock);
+    for (i = 0; i < OBJ_MAP_RING_SIZE; i++) {
+        if (ring->maps[i].ref && ring->maps[i].frame_idx == frame_idx) {
+            map = &ring->maps[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ring->lock);
+
+    return map;
+}
+
+void obj_map_ring_ref(ObjMapRing *ring, ObjMap *map)
+{
+    pthread_mutex_lock(&ring->lock);
+    map->ref++;
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void obj_map_ring_put(ObjMapRing *ring, ObjMap *map)
+{
+    pthread_mutex_lock(&ring->lock);
+    if (--map->ref == 0)
+        pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->lock);
+}
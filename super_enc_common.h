@@ -5,6 +5,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef enum {
     SOC_RK3576 = 0,
@@ -16,4 +21,61 @@ typedef enum {
 #define FPRINT(fp, ...)  do { if (fp) { fprintf(fp, ## __VA_ARGS__); } }while(0)
 #define FCLOSE(fp)  do { if(fp)  fclose(fp); fp = NULL; } while (0)
 
+#define OBJ_MAP_RING_SIZE   2   /* one map filled by the nn while the encoder reads the other */
+
+typedef struct {
+    uint8_t *map; /* one byte for each 16x16 block in encoder order */
+    size_t size; /* bytes allocated for map */
+    int frame_idx; /* frame the map is filled for */
+    int foreground_area; /* [0, 100] of that frame */
+    int ref; /* holders of the map, it is reused once this drops to 0 */
+} ObjMap;
+
+typedef struct {
+    ObjMap maps[OBJ_MAP_RING_SIZE];
+    int next; /* map handed out by the next acquire */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} ObjMapRing;
+
+/**
+ * @brief init a ring of object maps, maps are allocated on first acquire
+ */
+int obj_map_ring_init(ObjMapRing *ring);
+
+/**
+ * @brief free all maps, none may be held any more
+ */
+void obj_map_ring_deinit(ObjMapRing *ring);
+
+/**
+ * @brief take the next map of the ring for a frame, waiting while it is still held, nn thread only
+ *
+ * @param size [IN] bytes needed, the map grows when smaller
+ * @param frame_idx [IN] frame the map is filled for
+ * @return ObjMap* cleared map holding one reference, NULL on failure
+ */
+ObjMap *obj_map_ring_acquire(ObjMapRing *ring, size_t size, int frame_idx);
+
+/**
+ * @brief look up the held map of a frame, the reference count is unchanged
+ *
+ * @return ObjMap* NULL if no map is held for frame_idx
+ */
+ObjMap *obj_map_ring_find(ObjMapRing *ring, int frame_idx);
+
+/**
+ * @brief add a holder to a map
+ */
+void obj_map_ring_ref(ObjMapRing *ring, ObjMap *map);
+
+/**
+ * @brief drop a holder of a map, the last one returns it to the ring
+ */
+void obj_map_ring_put(ObjMapRing *ring, ObjMap *map);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // __SUPER_ENC_COMMON_H__
\ No newline at end of file
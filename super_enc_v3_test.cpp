@@ -59,6 +59,11 @@ static MPP_RET super_enc_v3_test_init(SuperEncCtx *sec)
 
     super_dbg_func("enter\n");
 
+    if (obj_map_ring_init(&sec->obj_maps)) {
+        mpp_err_f("init object map ring failed\n");
+        return MPP_NOK;
+    }
+
     if (run_type != RUN_JPEG_RKNN && run_type != RUN_JPEG_RKNN_MPP) {
         sec->fp_input = fopen64(sec->args->file_input, "rb");
         if (!sec->fp_input) {
@@ -143,6 +148,8 @@ static MPP_RET super_enc_v3_test_deinit(SuperEncCtx *sec)
 
     SE_FREE(sec->mpp_ctx);
 
+    obj_map_ring_deinit(&sec->obj_maps);
+
     FCLOSE(sec->fp_input);
     FCLOSE(sec->fp_output);
     FCLOSE(sec->fp_nn_out);
@@ -13,8 +13,10 @@ typedef struct {
     image_buffer_t src_image;
     image_buffer_t dst_image;
     RknnCtx rknn_ctx;
-    rknn_output outputs[7];
-    object_map_result_list om_results;
+    rknn_output *outputs; /* io_num.n_output entries */
+    RK_U8 *outputs_pool; /* cache line aligned staging when zero copy is off */
+    object_map_result_list om_results; /* object_seg_map points into obj_maps while the nn fills it */
+    ObjMapRing obj_maps; /* object maps held by the nn or until the encoder returns their packet */
     object_detect_result_list od_results;
 
     void *mpp_ctx;
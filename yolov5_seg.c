@@ -37,27 +37,39 @@ RKYOLORetCode init_yolov5_seg_model(const char *model_path, RknnCtx *nn_ctx)
 {
     int ret;
     int model_len = 0;
-    char *model;
+    void *model = NULL;
+    int model_mapped = 1;
     rknn_context ctx = 0;
+    RK_S64 time_start, time_load, time_init;
 
     seg_dbg_func("enter\n");
 
     if (nn_ctx->show_time_lvl >= 1)
         seg_debug |= SEG_DBG_TIME;
 
-    // Load RKNN Model
-    model_len = read_data_from_file(model_path, &model);
-    if (model == NULL) {
+    // Load RKNN Model, map it to save the heap copy, rknn_init parses from the page cache
+    time_start = mpp_time();
+    model_len = map_data_from_file(model_path, &model);
+    if (model_len < 0) {
+        model_mapped = 0;
+        model_len = read_data_from_file(model_path, (char **)&model);
+    }
+    if (model_len < 0 || model == NULL) {
         mpp_err("load_model fail!\n");
         return ROCKIVA_RET_FAIL;
     }
+    time_load = mpp_time();
 
     ret = rknn_init(&ctx, model, model_len, 0, NULL);
-    free(model);
+    if (model_mapped)
+        unmap_data(model, model_len);
+    else
+        free(model);
     if (ret < 0) {
         mpp_err("rknn_init fail! ret=%d\n", ret);
         return ROCKIVA_RET_FAIL;
     }
+    time_init = mpp_time();
 
     {
         rknn_sdk_version version;
@@ -136,11 +148,126 @@ RKYOLORetCode init_yolov5_seg_model(const char *model_path, RknnCtx *nn_ctx)
     nn_ctx->is_quant = (attr->qnt_type == RKNN_TENSOR_QNT_AFFINE_ASYMMETRIC &&
                          attr->type != RKNN_TENSOR_FLOAT16);
 
+    mpp_log("rknn model %s %d bytes: load %0.2f ms, rknn_init %0.2f ms, query %0.2f ms\n",
+            model_mapped ? "mapped" : "read", model_len,
+            (float)(time_load - time_start) / 1000, (float)(time_init - time_load) / 1000,
+            (float)(mpp_time() - time_init) / 1000);
+
     seg_dbg_func("leave\n");
 
     return ROCKIVA_RET_SUCCESS;
 }
 
+static void unbind_yolov5_seg_io_mem(RknnCtx *nn_ctx)
+{
+    if (nn_ctx->output_mems) {
+        for (int i = 0; i < nn_ctx->io_num.n_output; i++) {
+            if (nn_ctx->output_mems[i])
+                rknn_destroy_mem(nn_ctx->rknn_ctx, nn_ctx->output_mems[i]);
+        }
+        SE_FREE(nn_ctx->output_mems);
+    }
+
+    if (nn_ctx->input_mem) {
+        rknn_destroy_mem(nn_ctx->rknn_ctx, nn_ctx->input_mem);
+        nn_ctx->input_mem = NULL;
+    }
+
+    nn_ctx->zero_copy = 0;
+}
+
+RKYOLORetCode bind_yolov5_seg_io_mem(RknnCtx *nn_ctx, image_buffer_t *dst_img, rknn_output outputs[])
+{
+    rknn_context ctx = nn_ctx->rknn_ctx;
+    rknn_tensor_attr in_attr = nn_ctx->input_attrs[0];
+    int alloc_dst = (dst_img->virt_addr == NULL);
+    int ret;
+
+    seg_dbg_func("enter\n");
+
+    /* letterbox output is packed RGB888, the npu converts it to the model input type */
+    in_attr.type = RKNN_TENSOR_UINT8;
+    in_attr.fmt = RKNN_TENSOR_NHWC;
+
+    dst_img->width = nn_ctx->model_width;
+    dst_img->height = nn_ctx->model_height;
+    dst_img->width_stride = in_attr.w_stride ? in_attr.w_stride : nn_ctx->model_width;
+    dst_img->height_stride = nn_ctx->model_height;
+    dst_img->format = IMAGE_FORMAT_RGB888;
+
+    if (alloc_dst) {
+        dst_img->size = in_attr.size_with_stride;
+        nn_ctx->input_mem = rknn_create_mem(ctx, dst_img->size);
+    } else {
+        /* dst_img is an external dma buffer, e.g. dma32 for rga on rk3588 */
+        nn_ctx->input_mem = rknn_create_mem_from_fd(ctx, dst_img->fd, dst_img->virt_addr, dst_img->size, 0);
+    }
+    if (!nn_ctx->input_mem) {
+        mpp_err_f("create input tensor mem size %d fail!\n", dst_img->size);
+        goto fail;
+    }
+
+    ret = rknn_set_io_mem(ctx, nn_ctx->input_mem, &in_attr);
+    if (ret < 0) {
+        mpp_err_f("rknn_set_io_mem input fail! ret=%d\n", ret);
+        goto fail;
+    }
+
+    if (alloc_dst) {
+        dst_img->fd = nn_ctx->input_mem->fd;
+        dst_img->virt_addr = (unsigned char *)nn_ctx->input_mem->virt_addr;
+    }
+
+    nn_ctx->output_mems = (rknn_tensor_mem **)calloc(nn_ctx->io_num.n_output, sizeof(rknn_tensor_mem *));
+    if (!nn_ctx->output_mems) {
+        mpp_err_f("malloc output mems fail!\n");
+        goto fail;
+    }
+
+    for (int i = 0; i < nn_ctx->io_num.n_output; i++) {
+        rknn_tensor_attr attr = nn_ctx->output_attrs[i];
+        int size = attr.n_elems * sizeof(int8_t);
+
+        /* keep the default nchw layout which post process indexes by */
+        if (!nn_ctx->is_quant) {
+            attr.type = RKNN_TENSOR_FLOAT32;
+            size = attr.n_elems * sizeof(float);
+        }
+
+        nn_ctx->output_mems[i] = rknn_create_mem(ctx, size);
+        if (!nn_ctx->output_mems[i]) {
+            mpp_err_f("create output %d tensor mem size %d fail!\n", i, size);
+            goto fail;
+        }
+
+        ret = rknn_set_io_mem(ctx, nn_ctx->output_mems[i], &attr);
+        if (ret < 0) {
+            mpp_err_f("rknn_set_io_mem output %d fail! ret=%d\n", i, ret);
+            goto fail;
+        }
+
+        outputs[i].index = i;
+        outputs[i].want_float = (!nn_ctx->is_quant);
+        outputs[i].is_prealloc = 0;
+        outputs[i].size = size;
+        outputs[i].buf = nn_ctx->output_mems[i]->virt_addr;
+    }
+
+    nn_ctx->zero_copy = 1;
+    seg_dbg_model("input mem fd %d size %d w_stride %d bound\n",
+                  dst_img->fd, dst_img->size, dst_img->width_stride);
+    seg_dbg_func("leave\n");
+
+    return ROCKIVA_RET_SUCCESS;
+
+fail:
+    unbind_yolov5_seg_io_mem(nn_ctx);
+    if (alloc_dst)
+        memset(dst_img, 0, sizeof(image_buffer_t));
+
+    return ROCKIVA_RET_FAIL;
+}
+
 RKYOLORetCode inference_yolov5_seg_model(RknnCtx *nn_ctx, image_buffer_t *img, rknn_output outputs[])
 {
     int ret;
@@ -148,7 +275,7 @@ RKYOLORetCode inference_yolov5_seg_model(RknnCtx *nn_ctx, image_buffer_t *img, r
     rknn_input *input = NULL;
     int bg_color = 114; // pad color for letterbox
     RK_S64 time_start, time_end;
-    int use_dma32_buf = nn_ctx->dst_img && nn_ctx->dst_img->use_dma32_buf;
+    int use_prealloc_dst = nn_ctx->dst_img != NULL;
 
     seg_dbg_func("enter\n");
 
@@ -165,7 +292,7 @@ RKYOLORetCode inference_yolov5_seg_model(RknnCtx *nn_ctx, image_buffer_t *img, r
     nn_ctx->input_image_width = img->width;
     nn_ctx->input_image_height = img->height;
 
-    if (use_dma32_buf) {
+    if (use_prealloc_dst) {
         dst_img = *nn_ctx->dst_img;
     } else {
         dst_img.width = nn_ctx->model_width;
@@ -189,39 +316,44 @@ RKYOLORetCode inference_yolov5_seg_model(RknnCtx *nn_ctx, image_buffer_t *img, r
     time_end = mpp_time();
     seg_dbg_time("convert_image_with_letterbox(RGA) time: %0.2f ms\n", (float)(time_end - time_start) / 1000);
 
-    // Set Input Data
-    input->index = 0;
-    input->type = RKNN_TENSOR_UINT8;
-    input->fmt = RKNN_TENSOR_NHWC;
-    input->size = nn_ctx->model_width * nn_ctx->model_height * nn_ctx->model_channel;
-    input->buf = dst_img.virt_addr;
+    // Set Input Data, the letterbox buffer is the input tensor in zero copy mode
+    if (!nn_ctx->zero_copy) {
+        input->index = 0;
+        input->type = RKNN_TENSOR_UINT8;
+        input->fmt = RKNN_TENSOR_NHWC;
+        input->size = nn_ctx->model_width * nn_ctx->model_height * nn_ctx->model_channel;
+        input->buf = dst_img.virt_addr;
 
-    time_start = mpp_time();
-    ret = rknn_inputs_set(nn_ctx->rknn_ctx, nn_ctx->io_num.n_input, input);
-    if (ret < 0) {
-        mpp_err_f("rknn_input_set fail! ret=%d\n", ret);
-        return ROCKIVA_RET_FAIL;
+        time_start = mpp_time();
+        ret = rknn_inputs_set(nn_ctx->rknn_ctx, nn_ctx->io_num.n_input, input);
+        if (ret < 0) {
+            mpp_err_f("rknn_input_set fail! ret=%d\n", ret);
+            return ROCKIVA_RET_FAIL;
+        }
+        time_end = mpp_time();
+        seg_dbg_time("rknn_inputs_set time: %0.2f ms\n", (float)(time_end - time_start) / 1000);
     }
-    time_end = mpp_time();
-    seg_dbg_time("rknn_inputs_set time: %0.2f ms\n", (float)(time_end - time_start) / 1000);
 
     time_start = mpp_time();
     ret = rknn_run(nn_ctx->rknn_ctx, NULL);
     time_end = mpp_time();
     seg_dbg_time("rknn_run time: %0.2f ms\n", (float)(time_end - time_start) / 1000);
 
-    if (!use_dma32_buf && dst_img.virt_addr != NULL) {
+    if (!use_prealloc_dst && dst_img.virt_addr != NULL) {
         free(dst_img.virt_addr);
     }
 
-    time_start = mpp_time();
-    ret = rknn_outputs_get(nn_ctx->rknn_ctx, nn_ctx->io_num.n_output, outputs, NULL);
-    if (ret < 0) {
-        mpp_err_f("rknn_outputs_get fail! ret=%d\n", ret);
-        return ROCKIVA_RET_FAIL;
+    // Outputs are read in place from the bound npu buffers in zero copy mode
+    if (!nn_ctx->zero_copy) {
+        time_start = mpp_time();
+        ret = rknn_outputs_get(nn_ctx->rknn_ctx, nn_ctx->io_num.n_output, outputs, NULL);
+        if (ret < 0) {
+            mpp_err_f("rknn_outputs_get fail! ret=%d\n", ret);
+            return ROCKIVA_RET_FAIL;
+        }
+        time_end = mpp_time();
+        seg_dbg_time("rknn_outputs_get time: %0.2f ms\n", (float)(time_end - time_start) / 1000);
     }
-    time_end = mpp_time();
-    seg_dbg_time("rknn_outputs_get time: %0.2f ms\n", (float)(time_end - time_start) / 1000);
 
     SE_FREE(input);
     seg_dbg_func("leave\n");
@@ -229,6 +361,47 @@ RKYOLORetCode inference_yolov5_seg_model(RknnCtx *nn_ctx, image_buffer_t *img, r
     return ROCKIVA_RET_SUCCESS;
 }
 
+/*
+ * Model mask column/row sampled for each input column/row, the nearest pixel
+ * of the letterbox inverse. Rebuilt only when the input size or padding changes.
+ */
+static RKYOLORetCode setup_mask_proj(RknnCtx *nn_ctx, int pic_width, int pic_height)
+{
+    letterbox_t *lb = &nn_ctx->letter_box;
+    int crop_w = nn_ctx->model_width - lb->x_pad * 2;
+    int crop_h = nn_ctx->model_height - lb->y_pad * 2;
+    int i;
+
+    if (nn_ctx->proj_x && nn_ctx->proj_w == pic_width && nn_ctx->proj_h == pic_height &&
+        nn_ctx->proj_pad_x == lb->x_pad && nn_ctx->proj_pad_y == lb->y_pad)
+        return ROCKIVA_RET_SUCCESS;
+
+    SE_FREE(nn_ctx->proj_x);
+    SE_FREE(nn_ctx->proj_y);
+    nn_ctx->proj_x = (uint16_t *)malloc(pic_width * sizeof(uint16_t));
+    nn_ctx->proj_y = (uint16_t *)malloc(pic_height * sizeof(uint16_t));
+    nn_ctx->frame_alloc_num += 2;
+    if (!nn_ctx->proj_x || !nn_ctx->proj_y) {
+        mpp_err_f("malloc mask projection of %dx%d failed\n", pic_width, pic_height);
+        SE_FREE(nn_ctx->proj_x);
+        SE_FREE(nn_ctx->proj_y);
+        return ROCKIVA_RET_FAIL;
+    }
+
+    /* pixel centre (i + 0.5) * crop / pic in the un-padded part of the model input */
+    for (i = 0; i < pic_width; i++)
+        nn_ctx->proj_x[i] = lb->x_pad + VPU_MIN((2 * i + 1) * crop_w / (2 * pic_width), crop_w - 1);
+    for (i = 0; i < pic_height; i++)
+        nn_ctx->proj_y[i] = lb->y_pad + VPU_MIN((2 * i + 1) * crop_h / (2 * pic_height), crop_h - 1);
+
+    nn_ctx->proj_w = pic_width;
+    nn_ctx->proj_h = pic_height;
+    nn_ctx->proj_pad_x = lb->x_pad;
+    nn_ctx->proj_pad_y = lb->y_pad;
+
+    return ROCKIVA_RET_SUCCESS;
+}
+
 RKYOLORetCode post_process_image(RknnCtx *nn_ctx, object_detect_result_list *od_results,
                                  rknn_output outputs[])
 {
@@ -239,6 +412,9 @@ RKYOLORetCode post_process_image(RknnCtx *nn_ctx, object_detect_result_list *od_
 
     seg_dbg_func("enter\n");
 
+    /* counts the buffers of this frame up to its block map */
+    nn_ctx->frame_alloc_num = 0;
+
 #if 0
     post_process(nn_ctx, outputs, &nn_ctx->letter_box, box_conf_threshold, nms_threshold, od_results);
 #else
@@ -248,6 +424,10 @@ RKYOLORetCode post_process_image(RknnCtx *nn_ctx, object_detect_result_list *od_
     seg_dbg_time("calc_instance_mask(postprocess) time: %0.2f ms\n", (float)(time_end - time_start) / 1000);
 
     if (nn_ctx->segmap_calc_en) {
+        /* the input resolution mask and the projected block map both sample through these */
+        if (setup_mask_proj(nn_ctx, nn_ctx->input_image_width, nn_ctx->input_image_height))
+            return ROCKIVA_RET_FAIL;
+
         time_start = mpp_time();
         trans_detect_result(nn_ctx, &nn_ctx->letter_box, od_results);
         time_end = mpp_time();
@@ -260,92 +440,282 @@ RKYOLORetCode post_process_image(RknnCtx *nn_ctx, object_detect_result_list *od_
     return ROCKIVA_RET_SUCCESS;
 }
 
-static void get_blk_object(int blk_pos_x, int blk_pos_y, int pic_width,int pic_height,
-                           uint8_t *seg_mask, uint8_t *object_map, int pos_in_16x16_blk)
+/* set bits of mask_bits in columns x0..x1 and rows y0..y1 */
+static int mask_bits_count(RknnCtx *nn_ctx, int x0, int x1, int y0, int y1)
 {
-    int roi_calc_list[6];
-    int k, l, pos_idx, m;
-    int blk_end_x, blk_end_y;
+    int w0 = x0 >> 6;
+    int w1 = x1 >> 6;
+    uint64_t m0 = ~0ULL << (x0 & 63);
+    uint64_t m1 = ~0ULL >> (63 - (x1 & 63));
+    int cnt = 0;
+    int y, w;
+
+    for (y = y0; y <= y1; y++) {
+        const uint64_t *row = nn_ctx->mask_bits + y * nn_ctx->mask_bits_stride;
+
+        if (w0 == w1) {
+            cnt += __builtin_popcountll(row[w0] & m0 & m1);
+            continue;
+        }
+        cnt += __builtin_popcountll(row[w0] & m0);
+        for (w = w0 + 1; w < w1; w++)
+            cnt += __builtin_popcountll(row[w]);
+        cnt += __builtin_popcountll(row[w1] & m1);
+    }
 
-    if (blk_pos_x > pic_width || blk_pos_y > pic_height) {
-        object_map[pos_in_16x16_blk] = 0; // 0 means background
-        return;
+    return cnt;
+}
+
+#define BLK_TASK_MAX    8   /* slices of block rows at most */
+#define BLK_CLASS_NUM   6   /* mask labels counted per block, larger ones are ignored */
+
+/* block rows/columns of the input and their mask footprint, full_mask_en masks are the input itself */
+static void blk_span(RknnCtx *nn_ctx, int pos, int size, const uint16_t *proj, int *start, int *end)
+{
+    int last = VPU_MIN(pos + 15, size - 1);
+
+    if (nn_ctx->full_mask_en) {
+        *start = pos;
+        *end = last;
+    } else {
+        *start = proj[pos];
+        *end = proj[last];
     }
+}
 
-    // calculate the block end position
-    blk_end_x = VPU_MIN(blk_pos_x + 15, pic_width - 1);
-    blk_end_y = VPU_MIN(blk_pos_y + 15, pic_height - 1);
-
-    memset(&roi_calc_list, 0, sizeof(int) * 6);
-    // calculate the number of pixels (in a 16x16 block) in each category
-    for (k = blk_pos_y; k <= blk_end_y; k += 2) {
-        for (l = blk_pos_x; l <= blk_end_x; l += 2) {
-            pos_idx = l + k * pic_width;
-            if (seg_mask[pos_idx] == 0)
-                roi_calc_list[0]++;
-            else if (seg_mask[pos_idx] == 1)
-                roi_calc_list[1]++;
-            else if (seg_mask[pos_idx] == 2)
-                roi_calc_list[2]++;
-            else if (seg_mask[pos_idx] == 3)
-                roi_calc_list[3]++;
-            else if (seg_mask[pos_idx] == 4)
-                roi_calc_list[4]++;
-            else if (seg_mask[pos_idx] == 5)
-                roi_calc_list[5]++;
-        }
+static RKYOLORetCode setup_blk_class(RknnCtx *nn_ctx, int pic_width, int pic_height)
+{
+    int blk_w = (pic_width + 15) / 16;
+    int blk_h = (pic_height + 15) / 16;
+    int cnt_w = MPP_MAX(pic_width, nn_ctx->model_width) + 1;
+    int cnt_num = worker_pool_thread_num(nn_ctx->blk_pool);
+
+    if (nn_ctx->blk_class && nn_ctx->blk_w == blk_w && nn_ctx->blk_h == blk_h && nn_ctx->band_cnt_w >= cnt_w &&
+        nn_ctx->band_cnt_num >= cnt_num)
+        return ROCKIVA_RET_SUCCESS;
+
+    SE_FREE(nn_ctx->blk_class);
+    SE_FREE(nn_ctx->band_cnt);
+    nn_ctx->blk_class = (uint8_t *)malloc(blk_w * blk_h);
+    nn_ctx->band_cnt = (uint32_t *)malloc(cnt_num * (BLK_CLASS_NUM + 1) * cnt_w * sizeof(uint32_t));
+    nn_ctx->frame_alloc_num += 2;
+    if (!nn_ctx->blk_class || !nn_ctx->band_cnt) {
+        mpp_err_f("malloc block classes of %dx%d failed\n", pic_width, pic_height);
+        SE_FREE(nn_ctx->blk_class);
+        SE_FREE(nn_ctx->band_cnt);
+        return ROCKIVA_RET_FAIL;
     }
-    // default value is 6, which means this block has different object or at the boundary of the image
-    object_map[pos_in_16x16_blk] = 6;
-    // get the category with the most pixels
-    for (m = 0; m < 6; m++) {
-        if (roi_calc_list[m] > (blk_end_y - blk_pos_y + 1) * (blk_end_x - blk_pos_x + 1) / 4 * 8 / 10) {
-            object_map[pos_in_16x16_blk] = m;
-            break;
+    nn_ctx->blk_w = blk_w;
+    nn_ctx->blk_h = blk_h;
+    nn_ctx->band_cnt_w = cnt_w;
+    nn_ctx->band_cnt_num = cnt_num;
+
+    return ROCKIVA_RET_SUCCESS;
+}
+
+/*
+ * Class of every 16x16 block in raster order: 0..5 when more than 80% of the
+ * mask pixels the block covers have that label, 6 for mixed blocks. Each row
+ * of blocks sums per label column counts over the mask rows it covers and
+ * prefixes them along x, so every mask pixel is read once and a block costs
+ * two lookups per label. The merged bitset is counted with popcounts instead.
+ */
+static void calc_blk_class(RknnCtx *nn_ctx, const uint8_t *mask, int mask_width, int pic_width, int pic_height,
+                           int by_start, int by_end, uint32_t *cnt)
+{
+    int cnt_w = mask_width + 1;
+    int bx, by, m, x, y;
+
+    for (by = by_start; by < by_end; by++) {
+        uint8_t *blk_class = nn_ctx->blk_class + by * nn_ctx->blk_w;
+        int y0, y1;
+
+        blk_span(nn_ctx, by * 16, pic_height, nn_ctx->proj_y, &y0, &y1);
+
+        if (!mask) {
+            for (bx = 0; bx < nn_ctx->blk_w; bx++) {
+                int x0, x1, area, fg;
+
+                blk_span(nn_ctx, bx * 16, pic_width, nn_ctx->proj_x, &x0, &x1);
+                area = (x1 - x0 + 1) * (y1 - y0 + 1);
+                fg = mask_bits_count(nn_ctx, x0, x1, y0, y1);
+                blk_class[bx] = (area - fg > area * 8 / 10) ? 0 : (fg > area * 8 / 10) ? 1 : 6;
+            }
+            continue;
+        }
+
+        memset(cnt, 0, (BLK_CLASS_NUM + 1) * cnt_w * sizeof(uint32_t));
+        for (y = y0; y <= y1; y++) {
+            const uint8_t *row = mask + y * mask_width;
+
+            for (x = 0; x < mask_width; x++) {
+                uint8_t v = row[x];
+
+                cnt[(v < BLK_CLASS_NUM ? v : BLK_CLASS_NUM) * cnt_w + x + 1]++;
+            }
+        }
+        for (m = 0; m < BLK_CLASS_NUM; m++) {
+            uint32_t *c = cnt + m * cnt_w;
+
+            for (x = 1; x < cnt_w; x++)
+                c[x] += c[x - 1];
         }
+
+        for (bx = 0; bx < nn_ctx->blk_w; bx++) {
+            int x0, x1, thr;
+
+            blk_span(nn_ctx, bx * 16, pic_width, nn_ctx->proj_x, &x0, &x1);
+            thr = (x1 - x0 + 1) * (y1 - y0 + 1) * 8 / 10;
+
+            // default value is 6, which means this block has different object or at the boundary of the image
+            blk_class[bx] = 6;
+            for (m = 0; m < BLK_CLASS_NUM; m++) {
+                if (cnt[m * cnt_w + x1 + 1] - cnt[m * cnt_w + x0] > (uint32_t)thr) {
+                    blk_class[bx] = m;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+typedef struct {
+    RknnCtx *nn_ctx;
+    const uint8_t *mask;
+    int mask_width;
+    int pic_width;
+    int pic_height;
+    uint8_t *object_map;
+    int task_num;
+    int fg_num[BLK_TASK_MAX]; /* foreground blocks of each task */
+} BlkClassJob;
+
+/* a slice of block rows: classify, scatter to encoder order and count the foreground */
+static void blk_class_task(void *arg, int idx)
+{
+    BlkClassJob *job = (BlkClassJob *)arg;
+    RknnCtx *nn_ctx = job->nn_ctx;
+    int by_start = nn_ctx->blk_h * idx / job->task_num;
+    int by_end = nn_ctx->blk_h * (idx + 1) / job->task_num;
+    uint32_t *cnt = nn_ctx->band_cnt + idx * (BLK_CLASS_NUM + 1) * nn_ctx->band_cnt_w;
+    int fg = 0;
+    int i;
+
+    calc_blk_class(nn_ctx, job->mask, job->mask_width, job->pic_width, job->pic_height, by_start, by_end, cnt);
+
+    for (i = by_start * nn_ctx->blk_w; i < by_end * nn_ctx->blk_w; i++) {
+        uint8_t cls = nn_ctx->blk_class[i];
+
+        job->object_map[nn_ctx->ctu_order[i]] = cls;
+        fg += (cls >= 1);
+    }
+    job->fg_num[idx] = fg;
+}
+
+RKYOLORetCode setup_ctu_order(RknnCtx *nn_ctx, int pic_width, int pic_height, int ctu_size)
+{
+    int blk_w = (pic_width + 15) / 16;
+    int blk_h = (pic_height + 15) / 16;
+    int n = ctu_size / 16;
+    int ctu_cols = MPP_ALIGN(pic_width, ctu_size) / ctu_size;
+    int bx, by;
+
+    if (nn_ctx->ctu_order && nn_ctx->ctu_order_w == pic_width && nn_ctx->ctu_order_h == pic_height &&
+        nn_ctx->ctu_order_ctu == ctu_size)
+        return ROCKIVA_RET_SUCCESS;
+
+    SE_FREE(nn_ctx->ctu_order);
+    nn_ctx->ctu_order = (uint32_t *)malloc(blk_w * blk_h * sizeof(uint32_t));
+    nn_ctx->frame_alloc_num++;
+    if (!nn_ctx->ctu_order) {
+        mpp_err_f("malloc ctu order of %dx%d failed\n", pic_width, pic_height);
+        return ROCKIVA_RET_FAIL;
+    }
+
+    /* ctus are raster scanned, so are the blocks inside each ctu */
+    for (by = 0; by < blk_h; by++) {
+        for (bx = 0; bx < blk_w; bx++)
+            nn_ctx->ctu_order[by * blk_w + bx] = ((by / n) * ctu_cols + bx / n) * n * n + (by % n) * n + bx % n;
+    }
+
+    nn_ctx->ctu_order_w = pic_width;
+    nn_ctx->ctu_order_h = pic_height;
+    nn_ctx->ctu_order_ctu = ctu_size;
+
+    return ROCKIVA_RET_SUCCESS;
+}
+
+void dump_object_map(RknnCtx *nn_ctx, const uint8_t *object_map, int pic_width, int pic_height,
+                     int ctu_size, int frame_count)
+{
+    int n = ctu_size / 16;
+    int ctu_cols = MPP_ALIGN(pic_width, ctu_size) / ctu_size;
+    int b16_num = MPP_ALIGN(pic_width, ctu_size) / 16 * MPP_ALIGN(pic_height, ctu_size) / 16;
+    int idx;
+
+    if (!nn_ctx->fp_segmap)
+        return;
+
+    for (idx = 0; idx < b16_num; idx++) {
+        int ctu = idx / (n * n);
+        int sub = idx % (n * n);
+
+        if (object_map[idx] || idx == b16_num - 1)
+            FPRINT(nn_ctx->fp_segmap, "frame %d blk_idx %d (%d, %d) object_map %d\n", frame_count, idx,
+                   ctu % ctu_cols * ctu_size + sub % n * 16, ctu / ctu_cols * ctu_size + sub / n * 16,
+                   object_map[idx]);
     }
 }
 
 RKYOLORetCode seg_mask_to_class_map(RknnCtx *rknn_nn_ctx, object_detect_result_list *od_results,
                                     object_map_result_list *object_results, uint8_t ctu_size, int frame_count)
 {
-    int i, j, k, l, m;
-    int h, w, block_num, pos_idx;
-    int blk_pos_x, blk_pos_y, blk_end_x, blk_end_y;
+    int i;
     int pic_width = rknn_nn_ctx->input_image_width;
     int pic_height = rknn_nn_ctx->input_image_height;
     uint8_t *object_map = object_results->object_seg_map;
     uint8_t *seg_mask = od_results->results_seg[0].seg_mask;
     int b16_num = MPP_ALIGN(pic_width, ctu_size) / 16 * MPP_ALIGN(pic_height, ctu_size) / 16;
     int fg_b16_num = 0;
+    BlkClassJob job;
     RK_S64 time_start, time_end;
 
     seg_dbg_func("enter\n");
     time_start = mpp_time();
 
-    block_num = 0;
+    /* built on the first frame whatever it holds, later frames of the same size reuse them */
+    if (!rknn_nn_ctx->full_mask_en && setup_mask_proj(rknn_nn_ctx, pic_width, pic_height))
+        return ROCKIVA_RET_FAIL;
+    if (setup_blk_class(rknn_nn_ctx, pic_width, pic_height) ||
+        setup_ctu_order(rknn_nn_ctx, pic_width, pic_height, ctu_size))
+        return ROCKIVA_RET_FAIL;
+
     // if more than one object, we need to convert the object map
     if (od_results->count >= 1) {
         object_results->found_objects = 1;
 
-        for (h = 0; h < pic_height; h += ctu_size) {
-            for (w = 0; w < pic_width; w += ctu_size) {
-                for (i = 0; i < ctu_size / 16; i++) {
-                    for (j = 0; j < ctu_size / 16; j++) {
-                        blk_pos_x = w + j * 16;
-                        blk_pos_y = h + i * 16;
-                        // calculate the number of pixels (in a 16x16 block) in each category
-                        get_blk_object(blk_pos_x, blk_pos_y, pic_width, pic_height,
-                                       seg_mask, object_map, block_num);
-                        fg_b16_num += (object_map[block_num] >= 1);
-                        if (object_map[block_num] || (block_num == b16_num - 1))
-                            FPRINT(rknn_nn_ctx->fp_segmap, "frame %d blk_idx %d (%d, %d) object_map %d\n",
-                                   frame_count, block_num, blk_pos_x, blk_pos_y, object_map[block_num]);
-                        block_num++;
-                    }
-                }
-            }
+        job.nn_ctx = rknn_nn_ctx;
+        job.pic_width = pic_width;
+        job.pic_height = pic_height;
+        job.object_map = object_map;
+        if (rknn_nn_ctx->full_mask_en) {
+            job.mask = seg_mask;
+            job.mask_width = pic_width;
+        } else {
+            job.mask = rknn_nn_ctx->mask_bits ? NULL : rknn_nn_ctx->all_mask_in_one;
+            job.mask_width = rknn_nn_ctx->model_width;
         }
+        job.task_num = MPP_MIN3(rknn_nn_ctx->band_cnt_num, BLK_TASK_MAX, rknn_nn_ctx->blk_h);
+
+        /*
+         * classes are computed in raster order and scattered to encoder order, ctu padding is background.
+         * Slices of block rows run on the block map pool, each with its own band counts.
+         */
+        memset(object_map, 0, b16_num);
+        worker_pool_run(rknn_nn_ctx->blk_pool, blk_class_task, &job, job.task_num);
+        for (i = 0; i < job.task_num; i++)
+            fg_b16_num += job.fg_num[i];
+        dump_object_map(rknn_nn_ctx, object_map, pic_width, pic_height, ctu_size, frame_count);
     } else if (rknn_nn_ctx->fp_segmap) {
         /* for nn result debug */
         FPRINT(rknn_nn_ctx->fp_segmap, "frame %d blk_idx %d (0, 0) object_map 0\n", frame_count, b16_num - 1);
@@ -369,6 +739,14 @@ RKYOLORetCode release_yolov5_seg_model(RknnCtx *nn_ctx)
 {
     seg_dbg_func("enter\n");
 
+    unbind_yolov5_seg_io_mem(nn_ctx);
+
+    SE_FREE(nn_ctx->proj_x);
+    SE_FREE(nn_ctx->proj_y);
+    SE_FREE(nn_ctx->blk_class);
+    SE_FREE(nn_ctx->band_cnt);
+    SE_FREE(nn_ctx->ctu_order);
+
     SE_FREE(nn_ctx->input_attrs);
     SE_FREE(nn_ctx->output_attrs);
 
@@ -40,6 +40,16 @@ RKYOLORetCode init_yolov5_seg_model(const char *model_path, RknnCtx *nn_ctx);
  */
 RKYOLORetCode inference_yolov5_seg_model(RknnCtx *nn_ctx, image_buffer_t *img, rknn_output outputs[]);
 
+/**
+ * @brief 绑定输入输出tensor内存(零拷贝), 失败时保持rknn_inputs_set/rknn_outputs_get流程
+ *
+ * @param nn_ctx [IN] rknn输入参数
+ * @param dst_img [IN/OUT] letterbox输出图像, virt_addr为空时由npu分配
+ * @param outputs [OUT] buf指向npu输出内存
+ * @return RKYOLORetCode
+ */
+RKYOLORetCode bind_yolov5_seg_io_mem(RknnCtx *nn_ctx, image_buffer_t *dst_img, rknn_output outputs[]);
+
 /**
  * @brief 模型输出结果处理及buffer释放
  *
@@ -61,6 +71,28 @@ RKYOLORetCode post_process_image(RknnCtx *nn_ctx, object_detect_result_list *od_
 RKYOLORetCode seg_mask_to_class_map(RknnCtx *nn_ctx, object_detect_result_list *od_results,
                                     object_map_result_list *object_results, uint8_t ctu_size, int frame_count);
 
+/**
+ * @brief 生成光栅顺序16x16块到编码器ctu顺序的索引表, 分辨率或ctu_size不变时直接复用
+ *
+ * @param nn_ctx [IN] rknn输入参数
+ * @param pic_width [IN] 输入图像宽
+ * @param pic_height [IN] 输入图像高
+ * @param ctu_size [IN] 16/32/64
+ * @return RKYOLORetCode
+ */
+RKYOLORetCode setup_ctu_order(RknnCtx *nn_ctx, int pic_width, int pic_height, int ctu_size);
+
+/**
+ * @brief 按编码顺序将object_map的前景块及最后一块写入-nn_out调试文件
+ *
+ * @param nn_ctx [IN] rknn输入参数
+ * @param object_map [IN] ctu顺序的块类别
+ * @param ctu_size [IN] 16/32/64
+ * @param frame_count [IN] 帧号
+ */
+void dump_object_map(RknnCtx *nn_ctx, const uint8_t *object_map, int pic_width, int pic_height,
+                     int ctu_size, int frame_count);
+
 /**
  * @brief 释放资源
  *